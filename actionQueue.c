@@ -0,0 +1,121 @@
+/* 
+ * File:   actionQueue.c
+ * Author: Ian
+ * 
+ * Output changes which have to happen later - the end of a pulse, the next
+ * toggle of a flashing output, the power up restore of an output or the next
+ * step of a timed sequence. The entries are held in a list sorted by time so
+ * each pass of the main loop only has to compare the head entry with the 
+ * time, however many actions are pending. The entries come from a fixed pool
+ * linked through the next field.
+ *
+ * Created on 14 October 2026
+ */
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/TickTime.h"
+#include "mioNv.h"
+#include "ioCache.h"
+#include "actionQueue.h"
+#include "stateStore.h"
+#include "mioEvents.h"
+
+#define NO_ENTRY    0xFF
+
+typedef struct {
+    DWORD when;
+    BYTE next;      // next entry in the pending or free list
+    BYTE kind;
+    BYTE io;
+    BYTE arg;
+} DeferredAction;
+
+static DeferredAction entries[ACTION_QUEUE_SIZE];
+static BYTE head;       // earliest pending entry
+static BYTE freeList;
+
+// Externs
+extern void setOutput(unsigned char io, unsigned char action, unsigned char type);
+extern void endOutputPulse(unsigned char io);
+extern void toggleFlashingOutput(unsigned char io, BOOL state, DWORD due);
+
+void initActionQueue(void) {
+    unsigned char i;
+    
+    head = NO_ENTRY;
+    for (i=0; i<ACTION_QUEUE_SIZE-1; i++) {
+        entries[i].next = i+1;
+    }
+    entries[ACTION_QUEUE_SIZE-1].next = NO_ENTRY;
+    freeList = 0;
+}
+
+BOOL deferAction(DWORD when, BYTE kind, BYTE io, BYTE arg) {
+    BYTE e;
+    BYTE * link;
+    
+    if (freeList == NO_ENTRY) return FALSE;
+    e = freeList;
+    freeList = entries[e].next;
+    entries[e].when = when;
+    entries[e].kind = kind;
+    entries[e].io = io;
+    entries[e].arg = arg;
+    // insert after any entries due at the same time so equal times keep their order
+    link = &head;
+    while ((*link != NO_ENTRY) && ((long)(entries[*link].when - when) <= 0)) {
+        link = &entries[*link].next;
+    }
+    entries[e].next = *link;
+    *link = e;
+    return TRUE;
+}
+
+void cancelDeferred(BYTE io, BYTE kind) {
+    BYTE * link;
+    BYTE e;
+    
+    link = &head;
+    while (*link != NO_ENTRY) {
+        e = *link;
+        if (((io == ANY_IO) || (entries[e].io == io)) && (entries[e].kind == kind)) {
+            *link = entries[e].next;
+            entries[e].next = freeList;
+            freeList = e;
+        } else {
+            link = &entries[e].next;
+        }
+    }
+}
+
+void pollActionQueue(void) {
+    BYTE e;
+    BYTE io;
+    BYTE arg;
+    DWORD when;
+    
+    while ((head != NO_ENTRY) && ((long)(tickGet() - entries[head].when) >= 0)) {
+        // take the entry off the list before acting as the action may schedule another
+        e = head;
+        head = entries[e].next;
+        entries[e].next = freeList;
+        freeList = e;
+        io = entries[e].io;
+        arg = entries[e].arg;
+        when = entries[e].when;
+        switch (entries[e].kind) {
+            case DEFERRED_PULSE_OFF:
+                endOutputPulse(io);
+                break;
+            case DEFERRED_FLASH:
+                toggleFlashingOutput(io, arg, when);
+                break;
+            case DEFERRED_RESTORE:
+                setOutput(io, getOutputState(io), ioConfig[io].nv.type);
+                break;
+            case DEFERRED_SEQUENCE:
+                continueSequence(io, arg);
+                break;
+        }
+    }
+}
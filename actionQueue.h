@@ -0,0 +1,53 @@
+/* 
+ * File:   actionQueue.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef ACTIONQUEUE_H
+#define	ACTIONQUEUE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+#define ACTION_QUEUE_SIZE       32
+#define ANY_IO                  0xFF
+
+    /*
+     * The kinds of deferred action.
+     */
+#define DEFERRED_PULSE_OFF      0   // end of a pulsed output
+#define DEFERRED_FLASH          1   // toggle a flashing output, arg is the next state
+#define DEFERRED_RESTORE        2   // restore the saved state of the IO at power up
+#define DEFERRED_SEQUENCE       3   // continue the EVs of event table index io from EV arg
+    
+    extern void initActionQueue(void);
+    /**
+     * Schedule an action for later.
+     * @param when absolute tick time
+     * @param kind DEFERRED_xxx
+     * @param io
+     * @param arg depends upon kind
+     * @return FALSE if the queue was full
+     */
+    extern BOOL deferAction(DWORD when, BYTE kind, BYTE io, BYTE arg);
+    /**
+     * Remove any pending actions of the given kind for the IO, or for all IOs
+     * if io is ANY_IO.
+     */
+    extern void cancelDeferred(BYTE io, BYTE kind);
+    /**
+     * Perform the actions which are due. Called every pass of the main loop.
+     */
+    extern void pollActionQueue(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ACTIONQUEUE_H */
+
@@ -0,0 +1,238 @@
+/* 
+ * File:   canFilters.c
+ * Author: Ian
+ * 
+ * Use the ECAN acceptance filters to reject accessory events which this 
+ * module doesn't consume so they don't cause an RX interrupt at all.
+ * 
+ * The CBUS standard identifier only holds the sender's priority and CANID so
+ * the filters are useless on the identifier. Instead the DeviceNet filtering
+ * of ECAN modes 1 and 2 is used, which compares the first 18 data bits - the
+ * opcode, the NN high byte and the top 2 bits of the NN low byte - against
+ * the filter EID bits. The filters are:
+ * <UL>
+ * <LI>Mask 0 (opcode bits 0x96 and all 10 NN bits): one filter per group of 
+ * 64 NNs holding a consumed long event.</LI>
+ * <LI>Mask 1 (opcode bits 0x90): opcodes 0x00, 0x10 and 0x80 patterns, which 
+ * are all the non event opcodes with either bit 7 or bit 4 clear.</LI>
+ * <LI>RXF15 as a mask (opcode bits 0x96): 0x92, 0x94 and 0x96 patterns, the 
+ * remaining non event opcodes.</LI>
+ * </UL>
+ * So every non event opcode is accepted, leaving the software opcode filter to
+ * drop those not wanted, and events are accepted for the consumed NN groups.
+ * The EN isn't within the bits which can be filtered so events from the same
+ * NN group are still received and rejected by the event index.
+ * 
+ * When the consumed events need more than MAX_NN_GROUPS groups, any short 
+ * event is consumed (short events carry the sender's NN so can't be filtered),
+ * the ECAN isn't in mode 1 or 2, NV_FLAG_CAN_FILTERS is clear, or the module
+ * is in learn mode (where received events may be taught), everything is 
+ * accepted. The controller is only touched when the filters need to change, 
+ * and when filtering is switched off the library's own acceptance setup, 
+ * saved when filtering was switched on, is put back.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/events.h"
+#include "../../CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "mioEvents.h"
+#include "canFilters.h"
+
+#define NUM_NON_EVENT_FILTERS   6
+#define MAX_NN_GROUPS           (15 - NUM_NON_EVENT_FILTERS)
+#define NO_GROUP                0xFFFF
+
+// MSELn values
+#define USE_MASK0               0
+#define USE_MASK1               1
+#define USE_RXF15               2
+
+/*
+ * Each filter is 4 consecutive registers SIDH, SIDL, EIDH, EIDL. RXF15 is
+ * used as a mask so isn't an acceptance filter.
+ */
+static volatile unsigned char * const filterRegs[15] = {
+    &RXF0SIDH, &RXF1SIDH, &RXF2SIDH, &RXF3SIDH, &RXF4SIDH, &RXF5SIDH, &RXF6SIDH, &RXF7SIDH,
+    &RXF8SIDH, &RXF9SIDH, &RXF10SIDH, &RXF11SIDH, &RXF12SIDH, &RXF13SIDH, &RXF14SIDH
+};
+
+/*
+ * The single registers changed, the library's values are saved along with
+ * the filters and masks.
+ */
+static volatile unsigned char * const otherRegs[7] = {
+    &SDFLC, &MSEL0, &MSEL1, &MSEL2, &MSEL3, &RXFCON0, &RXFCON1
+};
+static volatile unsigned char * const maskRegs[3] = {
+    &RXM0SIDH, &RXM1SIDH, &RXF15SIDH
+};
+
+static WORD groups[MAX_NN_GROUPS];
+static BYTE numGroups;
+static BOOL filtersSet;                 // the module's filters are in use
+static WORD setGroups[MAX_NN_GROUPS];   // the groups in the filters
+static BYTE numSetGroups;
+static BYTE libraryFilters[15][4];
+static BYTE libraryMasks[3][4];
+static BYTE libraryOthers[7];
+
+/**
+ * Set a filter or mask. The SID bits are always 0 (don't care in the masks)
+ * and EXIDEN is 0 for standard frames.
+ * @param regs pointer to the SIDH register
+ * @param opc the opcode bits
+ * @param group bits 7:0 the NN high byte (data byte 1), bits 9:8 the top 2 bits
+ * of the NN low byte (data byte 2)
+ */
+static void setFilter(volatile unsigned char * regs, BYTE opc, WORD group) {
+    regs[0] = 0;                        // SIDH
+    regs[1] = (group >> 8) & 0x03;      // SIDL, EID17:16 = data byte 2 bits 7:6
+    regs[2] = opc;                      // EIDH = data byte 0
+    regs[3] = group & 0xFF;             // EIDL = data byte 1
+}
+
+/**
+ * Save the library's acceptance setup, or put it back.
+ * Must be called in configuration mode.
+ * @param save TRUE to save, FALSE to restore
+ */
+static void libraryFilterSetup(BOOL save) {
+    BYTE f;
+    BYTE r;
+    
+    for (f=0; f<15; f++) {
+        for (r=0; r<4; r++) {
+            if (save) {
+                libraryFilters[f][r] = filterRegs[f][r];
+            } else {
+                filterRegs[f][r] = libraryFilters[f][r];
+            }
+        }
+    }
+    for (f=0; f<3; f++) {
+        for (r=0; r<4; r++) {
+            if (save) {
+                libraryMasks[f][r] = maskRegs[f][r];
+            } else {
+                maskRegs[f][r] = libraryMasks[f][r];
+            }
+        }
+    }
+    for (r=0; r<7; r++) {
+        if (save) {
+            libraryOthers[r] = *otherRegs[r];
+        } else {
+            *otherRegs[r] = libraryOthers[r];
+        }
+    }
+}
+
+/**
+ * Check whether the filters already hold the groups found.
+ * @return TRUE if the filters need to be changed
+ */
+static BOOL groupsChanged(void) {
+    BYTE g;
+    
+    if (numGroups != numSetGroups) return TRUE;
+    for (g=0; g<numGroups; g++) {
+        if (groups[g] != setGroups[g]) return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Find the NN groups of the consumed events.
+ * @return FALSE if they can't be covered by the filters
+ */
+static BOOL findGroups(void) {
+    unsigned int i;
+    unsigned char g;
+    WORD nn;
+    WORD group;
+    
+    numGroups = 0;
+    for (i=0; i<NUM_CONSUMED_EVENTS; i++) {
+        if ( ! validStart(i)) continue;
+        if (getEv(i, 0) < ACTION_CONSUMER_BASE) continue;
+        nn = getNN(i);
+        if (nn == 0) return FALSE;      // short event
+        // bits 7:0 the NN high byte, bits 9:8 the top 2 bits of the NN low byte
+        group = (nn >> 8) | (((nn >> 6) & 0x03) << 8);
+        for (g=0; g<numGroups; g++) {
+            if (groups[g] == group) break;
+        }
+        if (g < numGroups) continue;
+        if (numGroups >= MAX_NN_GROUPS) return FALSE;
+        groups[numGroups++] = group;
+    }
+    return TRUE;
+}
+
+void rebuildCanFilters(void) {
+    BYTE reqop;
+    BYTE f;
+    BOOL filtering;
+    WORD enabled;
+    BYTE msel[4];
+    
+    // DeviceNet filtering is only available in modes 1 and 2
+    if ((ECANCON & 0xC0) == 0) return;
+    
+    filtering = (nodeVarTable.moduleNVs.flags & NV_FLAG_CAN_FILTERS) && 
+            (flimState != fsFLiMLearn) && findGroups();
+    // leave the controller alone unless the filters change, as frames may be
+    // lost whilst in configuration mode
+    if ( ! filtering && ! filtersSet) return;
+    if (filtering && filtersSet && ! groupsChanged()) return;
+    
+    // configuration mode
+    reqop = CANCON & 0xE0;
+    CANCON = (CANCON & 0x1F) | 0x80;
+    while ((CANSTAT & 0xE0) != 0x80)
+        ;
+    
+    if (filtering) {
+        if ( ! filtersSet) libraryFilterSetup(TRUE);
+        msel[0] = msel[1] = msel[2] = msel[3] = 0;
+        SDFLC = 18;                     // compare the first 18 data bits
+        setFilter(&RXM0SIDH, 0x96, 0x3FF);
+        setFilter(&RXM1SIDH, 0x90, 0);
+        setFilter(&RXF15SIDH, 0x96, 0);
+        setFilter(filterRegs[0], 0x00, 0);
+        setFilter(filterRegs[1], 0x10, 0);
+        setFilter(filterRegs[2], 0x80, 0);
+        setFilter(filterRegs[3], 0x92, 0);
+        setFilter(filterRegs[4], 0x94, 0);
+        setFilter(filterRegs[5], 0x96, 0);
+        msel[0] = (USE_MASK1 << 0) | (USE_MASK1 << 2) | (USE_MASK1 << 4) | (USE_RXF15 << 6);
+        msel[1] = (USE_RXF15 << 0) | (USE_RXF15 << 2);
+        for (f=0; f<numGroups; f++) {
+            // these use mask 0, the msel value of 0
+            setFilter(filterRegs[NUM_NON_EVENT_FILTERS+f], 0x90, groups[f]);
+            setGroups[f] = groups[f];
+        }
+        numSetGroups = numGroups;
+        enabled = (1 << (NUM_NON_EVENT_FILTERS + numGroups)) - 1;
+        MSEL0 = msel[0];
+        MSEL1 = msel[1];
+        MSEL2 = msel[2];
+        MSEL3 = msel[3];
+        RXFCON0 = enabled & 0xFF;
+        RXFCON1 = enabled >> 8;
+        filtersSet = TRUE;
+    } else {
+        // filtering switched off, back to what the library set up
+        libraryFilterSetup(FALSE);
+        filtersSet = FALSE;
+    }
+    
+    // back to the previous mode
+    CANCON = (CANCON & 0x1F) | reqop;
+    while ((CANSTAT & 0xE0) != reqop)
+        ;
+}
@@ -0,0 +1,30 @@
+/* 
+ * File:   canFilters.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef CANFILTERS_H
+#define	CANFILTERS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+    /**
+     * Program the ECAN acceptance filters from the consumed events, or accept
+     * everything if NV_FLAG_CAN_FILTERS isn't set or the events can't be covered.
+     * Must be called after any change to the taught events. The controller is
+     * only reconfigured if the filters change.
+     */
+    extern void rebuildCanFilters(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CANFILTERS_H */
+
@@ -2,8 +2,8 @@
  * File:   config.h
  * Author: Ian
  * 
- * This file contains the structure definition for a pin configuration. It 
- * provides the mapping between IO, Pin, Port/bit no.
+ * This file contains the structure definition for a resolved pin. The 
+ * mapping between IO, Pin, Port/bit no. for each board is in pinmap.h.
  *
  * Created on 10 April 2017, 19:31
  */
@@ -15,12 +15,16 @@
 extern "C" {
 #endif
 
- // General purpose pin usage
+ // Resolved pin, generated at compile time from the board's PIN_MAP
 typedef struct {
-    unsigned char pin;
-    char port;
-    unsigned char no;
-} Config;
+    volatile unsigned char * lat;   // the LAT register for the pin
+    volatile unsigned char * port;  // the PORT register for reading the pin
+    unsigned char setMask;          // OR with LAT to set the pin
+    unsigned char clearMask;        // AND with LAT to clear the pin
+} PinPort;
+
+#define PIN_SET(p)      (*((p)->lat) |= (p)->setMask)
+#define PIN_CLEAR(p)    (*((p)->lat) &= (p)->clearMask)
 
 #ifdef	__cplusplus
 }
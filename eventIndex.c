@@ -0,0 +1,343 @@
+/* 
+ * File:   eventIndex.c
+ * Author: Ian
+ * 
+ * A RAM index of the consumed events in the Flash event table at 
+ * AT_EVENT2ACTION. Received events are looked up here rather than through the 
+ * hash chains in the library so that the Flash table is only read once for an 
+ * event which is consumed and not at all for most events which are not.
+ * 
+ * The index has two parts:
+ * <UL>
+ * <LI>A 256 bit bloom style filter. Two bits are set for each consumed event 
+ * and any received event without both bits set is rejected immediately.</LI>
+ * <LI>An open addressed slot table holding an 8 bit tag and the event table 
+ * index. The tag avoids reading Flash for events which collide in the 
+ * filter. A hit is confirmed against the NN/EN in Flash.</LI>
+ * </UL>
+ * An event taught more than once has an entry for each and all are acted upon.
+ * Or, with EVENT_INDEX_SORTED, the slot table is replaced by the event table
+ * indexes of the consumed events in NN/EN order. A lookup is a binary search
+ * comparing against the NN/EN in Flash, at most 8 probes for 255 events, and
+ * the RAM used is one byte per consumed event.
+ * The index is rebuilt from the event table whenever events are taught or 
+ * removed.
+ * 
+ * Produced events are also looked up here so that an event which this module
+ * consumes, such as an input driving a local servo, is acted upon in the same
+ * main loop pass rather than never, as the module doesn't receive its own 
+ * frames. They are queued and dispatched from the main loop rather than from
+ * within the action which produced them, as the functions aren't reentrant.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/events.h"
+#include "../../CBUSlib/FLiM.h"
+#include "../../CBUSlib/TickTime.h"
+#include "mioEvents.h"
+#include "eventIndex.h"
+#include "perf.h"
+
+#if NUM_CONSUMED_EVENTS >= NO_INDEX
+#error "The event index holds at most 254 consumed events"
+#endif
+
+static BYTE bloom[EVENT_BLOOM_BYTES];
+#ifdef EVENT_INDEX_SORTED
+static BYTE sorted[NUM_CONSUMED_EVENTS];
+static BYTE numSorted;
+#else
+static BYTE slotTags[EVENT_INDEX_SLOTS];
+static BYTE slotIndexes[EVENT_INDEX_SLOTS];
+#endif
+
+typedef struct {
+    WORD nn;
+    WORD en;
+    BOOL on;
+    BYTE depth;     // number of looped back events which led to this one
+} LoopbackEvent;
+
+static LoopbackEvent loopbackQueue[LOOPBACK_QUEUE_SIZE];
+static BYTE loopbackHead;
+static BYTE loopbackCount;
+static BYTE loopbackDepth;      // depth of the event being dispatched, 0 if received
+
+// results of hashEvent()
+static BYTE hash;
+static BYTE tag;
+
+// the event being found, kept apart from hash and tag as performing the 
+// actions of one entry may loop back a produced event before the next is found
+static WORD findNn;
+static WORD findEn;
+#ifdef EVENT_INDEX_SORTED
+static BYTE findPos;
+#else
+static BYTE findTag;
+static BYTE findSlot;
+#endif
+
+/**
+ * Calculate the slot hash and the tag for an event. Only shifts and XORs so
+ * this takes a few cycles.
+ */
+static void hashEvent(WORD nn, WORD en) {
+    BYTE enLo = en & 0xFF;
+    BYTE nnLo = nn & 0xFF;
+    
+    hash = enLo ^ (en >> 8) ^ (nnLo << 3) ^ (nnLo >> 5) ^ (nn >> 8);
+    tag = ((enLo << 3) | (enLo >> 5)) ^ nnLo ^ ((nn >> 8) << 1) ^ ((en >> 8) << 4);
+}
+
+#define BLOOM_SET(h)    (bloom[(h) >> 3] |= (1 << ((h) & 7)))
+#define BLOOM_TEST(h)   (bloom[(h) >> 3] & (1 << ((h) & 7)))
+
+#ifdef EVENT_INDEX_SORTED
+/**
+ * Compare an event with the event at a table index.
+ * @return <0, 0 or >0 as the event is before, the same as or after the table event
+ */
+static signed char compareEvent(WORD nn, WORD en, BYTE index) {
+    WORD n = getNN(index);
+    WORD e;
+    
+    if (nn != n) return (nn < n) ? -1 : 1;
+    e = getEN(index);
+    if (en != e) return (en < e) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Binary search of the sorted index.
+ * @return the position of the first entry which isn't before the event
+ */
+static BYTE searchSorted(WORD nn, WORD en) {
+    BYTE lo = 0;
+    BYTE hi = numSorted;
+    BYTE mid;
+    
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (compareEvent(nn, en, sorted[mid]) <= 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+#endif
+
+/**
+ * Rebuild the index from the event table.
+ */
+void rebuildEventIndex(void) {
+    unsigned int i;
+    WORD nn;
+    WORD en;
+#ifdef EVENT_INDEX_SORTED
+    BYTE pos;
+    BYTE j;
+#else
+    BYTE slot;
+#endif
+    
+    for (i=0; i<EVENT_BLOOM_BYTES; i++) {
+        bloom[i] = 0;
+    }
+#ifdef EVENT_INDEX_SORTED
+    numSorted = 0;
+#else
+    for (i=0; i<EVENT_INDEX_SLOTS; i++) {
+        slotIndexes[i] = NO_INDEX;
+    }
+#endif
+    for (i=0; i<NUM_CONSUMED_EVENTS; i++) {
+        if ( ! validStart(i)) continue;
+        // only index the consumed events
+        if (getEv(i, 0) < ACTION_CONSUMER_BASE) continue;
+        nn = getNN(i);
+        en = getEN(i);
+        hashEvent(nn, en);
+        BLOOM_SET(hash);
+        BLOOM_SET(tag);
+#ifdef EVENT_INDEX_SORTED
+        // binary insertion after any entries for the same event, so these
+        // stay in table order
+        pos = searchSorted(nn, en);
+        while ((pos < numSorted) && (compareEvent(nn, en, sorted[pos]) == 0)) {
+            pos++;
+        }
+        for (j=numSorted; j>pos; j--) {
+            sorted[j] = sorted[j-1];
+        }
+        sorted[pos] = i;
+        numSorted++;
+#else
+        slot = hash;
+        while (slotIndexes[slot] != NO_INDEX) {
+            slot = (slot + 1) & (EVENT_INDEX_SLOTS - 1);
+        }
+        slotTags[slot] = tag;
+        slotIndexes[slot] = i;
+#endif
+    }
+}
+
+#ifndef EVENT_INDEX_SORTED
+/**
+ * Probe the slots from findSlot for the event being found.
+ * @return the event table index, with findSlot left at its slot, or NO_INDEX
+ */
+static BYTE searchSlots(void) {
+    BYTE index;
+    
+    while ((index = slotIndexes[findSlot]) != NO_INDEX) {
+        if ((slotTags[findSlot] == findTag) && (getEN(index) == findEn) && (getNN(index) == findNn)) {
+            return index;
+        }
+        findSlot = (findSlot + 1) & (EVENT_INDEX_SLOTS - 1);
+    }
+    return NO_INDEX;
+}
+#endif
+
+/**
+ * Find the first event table entry for a consumed event. The same event may
+ * be taught more than once, e.g. one entry per action, so nextEventIndex()
+ * returns the others.
+ * @param nn the event NN, 0 for short events
+ * @param en the event EN
+ * @return the event table index or NO_INDEX if the event isn't consumed
+ */
+BYTE findEventIndex(WORD nn, WORD en) {
+    hashEvent(nn, en);
+    if ( ! (BLOOM_TEST(hash) && BLOOM_TEST(tag))) return NO_INDEX;
+    findNn = nn;
+    findEn = en;
+#ifdef EVENT_INDEX_SORTED
+    findPos = searchSorted(nn, en);
+    if ((findPos < numSorted) && (compareEvent(nn, en, sorted[findPos]) == 0)) {
+        return sorted[findPos];
+    }
+    return NO_INDEX;
+#else
+    findTag = tag;
+    findSlot = hash;
+    return searchSlots();
+#endif
+}
+
+/**
+ * Find the next event table entry for the event of the last findEventIndex().
+ * @return the event table index or NO_INDEX if there are no more
+ */
+BYTE nextEventIndex(void) {
+#ifdef EVENT_INDEX_SORTED
+    findPos++;
+    if ((findPos < numSorted) && (compareEvent(findNn, findEn, sorted[findPos]) == 0)) {
+        return sorted[findPos];
+    }
+    return NO_INDEX;
+#else
+    findSlot = (findSlot + 1) & (EVENT_INDEX_SLOTS - 1);
+    return searchSlots();
+#endif
+}
+
+/**
+ * Handle a received accessory event.
+ * @param msg the received CBUS message
+ */
+void dispatchEvent(BYTE * msg) {
+    WORD nn;
+    WORD en;
+    BYTE index;
+    WORD start;
+    WORD t;
+    
+    start = TMR1;
+    if (IS_SHORT_EVENT_OPC(msg[d0])) {
+        nn = 0;
+    } else {
+        nn = ((WORD)msg[d1] << 8) | msg[d2];
+    }
+    en = ((WORD)msg[d3] << 8) | msg[d4];
+    index = findEventIndex(nn, en);
+    t = TMR1 - start;
+    if (t > perf.lookupMax) perf.lookupMax = t;
+    if (index == NO_INDEX) {
+        PERF_INC(perf.lookupMiss);
+        return;
+    }
+    PERF_INC(perf.lookupHit);
+    perfEventTime = tickGet();
+    perfInEvent = TRUE;
+    // every entry taught for the event is acted upon, in table order
+    do {
+        processEventActions(index, msg);
+        index = nextEventIndex();
+    } while (index != NO_INDEX);
+    perfInEvent = FALSE;
+    t = TMR1 - start;
+    if (t > perf.dispatchMax) perf.dispatchMax = t;
+}
+
+/**
+ * Queue a Produced event to be acted upon if this module also consumes it.
+ * Not done in learn mode, the same as received events.
+ * @param nn the event NN, 0 for a short event
+ * @param en the event EN
+ * @param on TRUE for an ON event
+ */
+void loopbackEvent(WORD nn, WORD en, BOOL on) {
+    LoopbackEvent * entry;
+    
+    if (flimState == fsFLiMLearn) return;
+    // a chain of taught events mustn't go round forever
+    if (loopbackDepth >= MAX_LOOPBACK_DEPTH) return;
+    // most produced events aren't consumed here so don't queue them
+    hashEvent(nn, en);
+    if ( ! (BLOOM_TEST(hash) && BLOOM_TEST(tag))) return;
+    if (loopbackCount >= LOOPBACK_QUEUE_SIZE) return;
+    entry = &loopbackQueue[(loopbackHead + loopbackCount) & (LOOPBACK_QUEUE_SIZE - 1)];
+    entry->nn = nn;
+    entry->en = en;
+    entry->on = on;
+    entry->depth = loopbackDepth + 1;
+    loopbackCount++;
+}
+
+/**
+ * Dispatch the looped back events. A message is built as if the event had 
+ * been received and dispatched in the same way. Events looped back whilst 
+ * doing so wait for the next pass.
+ */
+void pollLoopback(void) {
+    BYTE msg[20];
+    BYTE n;
+    LoopbackEvent * entry;
+    
+    for (n = loopbackCount; n; n--) {
+        entry = &loopbackQueue[loopbackHead];
+        if (entry->nn == 0) {
+            msg[d0] = entry->on ? OPC_ASON : OPC_ASOF;
+        } else {
+            msg[d0] = entry->on ? OPC_ACON : OPC_ACOF;
+        }
+        msg[d1] = entry->nn >> 8;
+        msg[d2] = entry->nn & 0xFF;
+        msg[d3] = entry->en >> 8;
+        msg[d4] = entry->en & 0xFF;
+        loopbackDepth = entry->depth;
+        loopbackHead = (loopbackHead + 1) & (LOOPBACK_QUEUE_SIZE - 1);
+        loopbackCount--;
+        PERF_INC(perf.loopback);
+        dispatchEvent(msg);
+    }
+    loopbackDepth = 0;
+}
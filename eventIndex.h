@@ -0,0 +1,73 @@
+/* 
+ * File:   eventIndex.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef EVENTINDEX_H
+#define	EVENTINDEX_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+    /*
+     * Define EVENT_INDEX_SORTED to index the consumed events with an array of
+     * event table indexes sorted by NN/EN and searched by binary search, in
+     * place of the hash slot table. It needs one byte per consumed event
+     * rather than two per slot, and a lookup reads at most 8 events from Flash.
+     */
+//#define EVENT_INDEX_SORTED
+
+#define EVENT_INDEX_SLOTS       256     // must be a power of 2 and more than NUM_CONSUMED_EVENTS
+#define EVENT_BLOOM_BYTES       32      // 256 bit reject filter
+#define NO_INDEX                0xFF
+#define LOOPBACK_QUEUE_SIZE     8       // must be a power of 2
+#define MAX_LOOPBACK_DEPTH      2       // events produced by looped back events are followed this deep
+
+    /*
+     * The accessory event opcodes ACON, ACOF, ASON, ASOF and their 1, 2 and 
+     * 3 data byte variants all match this pattern and no other opcodes do.
+     */
+#define IS_EVENT_OPC(opc)       (((opc) & 0x96) == 0x90)
+#define IS_SHORT_EVENT_OPC(opc) ((opc) & 0x08)
+
+    /**
+     * Rebuild the index from the event table in Flash. Must be called after
+     * any change to the taught events.
+     */
+    extern void rebuildEventIndex(void);
+    /**
+     * Find the first event table entry of a consumed event.
+     * @return the event table index or NO_INDEX if the event isn't consumed
+     */
+    extern BYTE findEventIndex(WORD nn, WORD en);
+    /**
+     * Find the next entry of the event of the last findEventIndex().
+     * @return the event table index or NO_INDEX if there are no more
+     */
+    extern BYTE nextEventIndex(void);
+    /**
+     * Handle a received accessory event. Events not consumed are rejected
+     * without accessing the Flash event table.
+     */
+    extern void dispatchEvent(BYTE * msg);
+    /**
+     * Queue a Produced event to be acted upon if this module also consumes 
+     * it. The CAN controller never receives its own frames.
+     */
+    extern void loopbackEvent(WORD nn, WORD en, BOOL on);
+    /**
+     * Dispatch the looped back events. Called every pass of the main loop.
+     */
+    extern void pollLoopback(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* EVENTINDEX_H */
+
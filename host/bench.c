@@ -0,0 +1,148 @@
+/*
+ * File:   bench.c
+ * Author: Ian
+ *
+ * Benchmark of the module's hot paths on the host: the consumed event lookup,
+ * dispatching a consumed event to its actions and packing the servo frame.
+ * The times are host times so they are only good for comparing one build of
+ * the module with another, not for the time taken on the PIC.
+ *
+ *   bench [iterations]
+ *
+ * Created on 14 October 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <xc.h>
+#include "CBUSlib/GenericTypeDefs.h"
+#include "CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "mioEvents.h"
+#include "eventIndex.h"
+#include "txQueue.h"
+#include "host.h"
+
+#define NUM_SERVOS      8       // IOs 0..7 are servos, 8..15 outputs
+#define NUM_TAUGHT      160     // consumed events taught
+#define BENCH_NN        300     // NN of the taught events
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static void report(const char * name, double ns, long n) {
+    printf("%-28s %10.1f ns\n", name, ns/n);
+}
+
+/**
+ * Servos on the first IOs, outputs on the rest and NUM_TAUGHT events, each
+ * moving a servo or switching an output.
+ */
+static void setup(BYTE flags) {
+    BYTE io;
+    BYTE ev;
+    WORD n;
+
+    hostInit();
+    beginNvTransaction();
+    for (io=0; io<NUM_IO; io++) {
+        setType(io, (io < NUM_SERVOS) ? TYPE_SERVO : TYPE_OUTPUT);
+    }
+    writeNV(NV_FLAGS, flags);
+    commitNvTransaction();
+    hostClearEvents();
+    for (n=0; n<NUM_TAUGHT; n++) {
+        io = n % NUM_IO;
+        ev = (io < NUM_SERVOS) ? ACTION_IO_CONSUMER_SERVO_ON(io) : ACTION_IO_CONSUMER_OUTPUT_ON(io);
+        hostTeachEvent(BENCH_NN, n+1, &ev, 1);
+    }
+    rebuildEventIndex();
+    hostStart();
+}
+
+static void benchLookup(long n) {
+    double t;
+    long i;
+    volatile BYTE index;
+
+    t = now();
+    for (i=0; i<n; i++) {
+        index = findEventIndex(BENCH_NN, (i % NUM_TAUGHT) + 1);
+    }
+    report("lookup, hit", now() - t, n);
+    t = now();
+    for (i=0; i<n; i++) {
+        index = findEventIndex(BENCH_NN+1, (i % NUM_TAUGHT) + 1);
+    }
+    report("lookup, miss", now() - t, n);
+}
+
+static void benchDispatch(long n) {
+    BYTE msg[8];
+    double t;
+    double total;
+    long i;
+    WORD en;
+
+    msg[d0] = OPC_ACON;
+    msg[d1] = BENCH_NN >> 8;
+    msg[d2] = BENCH_NN & 0xFF;
+    total = 0;
+    for (i=0; i<n; i++) {
+        // outputs only, a servo move would make the later ones queue
+        en = NUM_SERVOS + (i % (NUM_IO - NUM_SERVOS)) + 1;
+        msg[d3] = en >> 8;
+        msg[d4] = en & 0xFF;
+        t = now();
+        dispatchEvent(msg);
+        total += now() - t;
+        // keep the TX queue from filling, not timed
+        txQueueDrain();
+        pollLoopback();
+    }
+    report("dispatch, output", total, n);
+}
+
+static void benchServoFrame(const char * name, BYTE flags, long n) {
+    BYTE msg[8];
+    BYTE io;
+    double t;
+    double total;
+    long i;
+
+    setup(flags);
+    // set all the servos moving so they are in the frame
+    msg[d0] = OPC_ACON;
+    msg[d1] = BENCH_NN >> 8;
+    msg[d2] = BENCH_NN & 0xFF;
+    for (io=0; io<NUM_SERVOS; io++) {
+        msg[d3] = 0;
+        msg[d4] = io + 1;
+        dispatchEvent(msg);
+    }
+    total = 0;
+    for (i=0; i<n; i++) {
+        t = now();
+        startServos();
+        total += now() - t;
+        hostEndServoPulses();
+    }
+    report(name, total, n);
+}
+
+int main(int argc, char ** argv) {
+    long n = (argc > 1) ? atol(argv[1]) : 1000000;
+
+    setup(0);
+    printf("%d IOs, %d servos, %d consumed events, %ld iterations\n", NUM_IO, NUM_SERVOS, NUM_TAUGHT, n);
+    benchLookup(n);
+    benchDispatch(n);
+    benchServoFrame("servo block, 50Hz frame", 0, n);
+    benchServoFrame("servo block, fast frame", NV_FLAG_FAST_SERVOS, n);
+    return 0;
+}
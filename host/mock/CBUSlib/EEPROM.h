@@ -0,0 +1,27 @@
+/*
+ * File:   EEPROM.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUSlib EEPROM access, backed by RAM.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef EEPROM_H
+#define	EEPROM_H
+
+#include "GenericTypeDefs.h"
+
+#define EE_TOP          0x3FF
+#define EE_BOOT_FLAG    EE_TOP
+#define EE_CAN_ID       (EE_TOP-1)
+#define EE_NODE_ID      (EE_TOP-3)
+#define EE_FLIM_MODE    (EE_TOP-4)
+#define EE_RESET        (EE_TOP-5)
+
+extern BYTE ee_read(WORD addr);
+extern void ee_write(WORD addr, BYTE data);
+extern WORD ee_read_short(WORD addr);
+extern void ee_write_short(WORD addr, WORD data);
+
+#endif	/* EEPROM_H */
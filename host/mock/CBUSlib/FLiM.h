@@ -0,0 +1,50 @@
+/*
+ * File:   FLiM.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUSlib FLiM node. Sent CBUS messages are captured
+ * by the host harness rather than going to a CAN driver.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef FLIM_H
+#define	FLIM_H
+
+#include "GenericTypeDefs.h"
+#include "cbusdefs8n.h"
+#include "events.h"
+#include "mioNv.h"
+
+    // CBUS message byte indexes
+enum { d0, d1, d2, d3, d4, d5, d6, d7 };
+
+typedef enum {
+    fsSLiM = 0,
+    fsFLiM,
+    fsPressed,
+    fsFlashing,
+    fsFLiMSetup,
+    fsFLiMLearn,
+    fsPressedFLiM,
+    fsPressedSetup
+} FLiMStates;
+
+typedef union {
+    ModuleNvDefs moduleNVs;
+    BYTE nodeVars[NV_NUM];
+} NodeVarTable;
+
+extern FLiMStates flimState;
+#ifdef HOST_NV_TABLE
+// the host build of mioNv.c defines the table in RAM so it can be flushed to
+extern NodeVarTable nodeVarTable;
+#else
+extern const NodeVarTable nodeVarTable;
+#endif
+
+extern BOOL cbusSendEvent(BYTE cbusNum, WORD nodeNumber, WORD eventNumber, BOOL onEvent);
+extern void cbusSendOpcMyNN(BYTE cbusNum, BYTE opc, BYTE * msg);
+extern BOOL thisNN(BYTE * msg);
+
+#endif	/* FLIM_H */
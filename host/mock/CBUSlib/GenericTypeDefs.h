@@ -0,0 +1,18 @@
+/*
+ * File:   GenericTypeDefs.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUSlib basic types.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef GENERICTYPEDEFS_H
+#define	GENERICTYPEDEFS_H
+
+typedef enum _BOOL { FALSE = 0, TRUE } BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned long DWORD;
+
+#endif	/* GENERICTYPEDEFS_H */
@@ -0,0 +1,32 @@
+/*
+ * File:   TickTime.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUSlib tick timer. Time only moves when the host
+ * harness advances it, with the same 16us tick as the library at 16MHz.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef TICKTIME_H
+#define	TICKTIME_H
+
+#include "GenericTypeDefs.h"
+
+typedef union {
+    DWORD Val;
+    BYTE v[4];
+} TickValue;
+
+#define ONE_SECOND              62500
+#define TWO_SECOND              (2*ONE_SECOND)
+#define HALF_SECOND             (ONE_SECOND/2)
+#define HUNDRED_MILI_SECOND     (ONE_SECOND/10)
+#define TEN_MILI_SECOND         (ONE_SECOND/100)
+#define ONE_MILI_SECOND         (ONE_SECOND/1000)
+
+extern void initTicker(void);
+extern DWORD tickGet(void);
+extern DWORD tickTimeSince(TickValue t);
+
+#endif	/* TICKTIME_H */
@@ -0,0 +1,27 @@
+/*
+ * File:   cbusdefs8n.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUS opcode definitions, only those the host build
+ * uses.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef CBUSDEFS8N_H
+#define	CBUSDEFS8N_H
+
+#define OPC_RDGN    0x87
+#define OPC_ACON    0x90
+#define OPC_ACOF    0x91
+#define OPC_ASON    0x98
+#define OPC_ASOF    0x99
+#define OPC_DGN     0xC7
+#define OPC_ACON1   0xB0
+#define OPC_ACOF1   0xB1
+#define OPC_ACON2   0xD0
+#define OPC_ACOF2   0xD1
+#define OPC_ACON3   0xF0
+#define OPC_ACOF3   0xF1
+
+#endif	/* CBUSDEFS8N_H */
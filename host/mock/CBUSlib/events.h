@@ -0,0 +1,31 @@
+/*
+ * File:   events.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUSlib event table. The table is held in RAM and
+ * filled by the host harness with hostTeachEvent().
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef EVENTS_H
+#define	EVENTS_H
+
+#include "GenericTypeDefs.h"
+#include "romops.h"
+#include "mioEvents.h"
+
+typedef struct {
+    WORD NN;
+    WORD EN;
+} Event;
+
+extern BOOL validStart(BYTE tableIndex);
+extern WORD getNN(BYTE tableIndex);
+extern WORD getEN(BYTE tableIndex);
+extern int getEv(BYTE tableIndex, BYTE evIndex);
+extern void doEvlrn(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal);
+extern void deleteAction(BYTE action);
+extern const Event * getProducedEvent(BYTE action);
+
+#endif	/* EVENTS_H */
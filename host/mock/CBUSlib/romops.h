@@ -0,0 +1,18 @@
+/*
+ * File:   romops.h
+ * Author: Ian
+ *
+ * Host build stub of the CBUSlib Flash image, the flush only counts.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef ROMOPS_H
+#define	ROMOPS_H
+
+#include "GenericTypeDefs.h"
+
+extern void writeFlashImage(BYTE * addr, BYTE data);
+extern void flushFlashImage(void);
+
+#endif	/* ROMOPS_H */
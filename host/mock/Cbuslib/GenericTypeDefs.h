@@ -0,0 +1,11 @@
+/*
+ * File:   GenericTypeDefs.h
+ * Author: Ian
+ *
+ * canmio.h includes the library with this spelling, which matters on a case
+ * sensitive host file system.
+ *
+ * Created on 14 October 2026
+ */
+
+#include "../CBUSlib/GenericTypeDefs.h"
@@ -0,0 +1,238 @@
+/*
+ * File:   cbuslib.c
+ * Author: Ian
+ *
+ * Host build stub of the parts of CBUSlib which the module uses. The event
+ * table, EEPROM and Flash image are held in RAM, tick time only moves when the
+ * harness advances it and sent events go to the harness rather than a CAN
+ * driver.
+ *
+ * A consumed event taught with more than one action has a table entry per
+ * action, as with the library. Produced events are kept in their own table.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <xc.h>
+#include "CBUSlib/GenericTypeDefs.h"
+#include "CBUSlib/TickTime.h"
+#include "CBUSlib/EEPROM.h"
+#include "CBUSlib/romops.h"
+#include "CBUSlib/events.h"
+#include "CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "host.h"
+
+FLiMStates flimState = fsFLiM;
+
+DWORD hostTicks;
+HostSentFunction hostSent;
+DWORD hostSentCount;
+BOOL hostTxFull;
+WORD hostFlashWrites;
+BYTE hostReply[8];
+
+/*
+ * Tick time
+ */
+void initTicker(void) {
+}
+
+DWORD tickGet(void) {
+    return hostTicks;
+}
+
+DWORD tickTimeSince(TickValue t) {
+    return hostTicks - t.Val;
+}
+
+/**
+ * Move time on, Timer1 as well as the tick.
+ * @param ticks the time to move on
+ */
+void hostAdvance(DWORD ticks) {
+    hostTicks += ticks;
+    TMR1 += (WORD)(ticks * HOST_TMR1_PER_TICK);
+}
+
+/*
+ * Data EEPROM
+ */
+static BYTE eeprom[EE_TOP+1];
+
+BYTE ee_read(WORD addr) {
+    return (addr <= EE_TOP) ? eeprom[addr] : 0xFF;
+}
+
+void ee_write(WORD addr, BYTE data) {
+    if (addr <= EE_TOP) eeprom[addr] = data;
+}
+
+WORD ee_read_short(WORD addr) {
+    return ee_read(addr) | ((WORD)ee_read(addr+1) << 8);
+}
+
+void ee_write_short(WORD addr, WORD data) {
+    ee_write(addr, data & 0xFF);
+    ee_write(addr+1, data >> 8);
+}
+
+/*
+ * Flash image. Only the NVs are held in Flash here, writes elsewhere are
+ * dropped. As with the library nothing changes until the image is flushed.
+ * The module writes an NV at AT_NV plus its CBUS NV index, which starts at 1,
+ * and reads it from the table by name, so NV n is byte n-1 of the table.
+ */
+static BYTE nvImage[NV_NUM];
+static BOOL nvImageLoaded;
+static BOOL nvImageDirty;
+
+void writeFlashImage(BYTE * addr, BYTE data) {
+    size_t a = (size_t)addr;
+
+    if ((a <= AT_NV) || (a > AT_NV + NV_NUM)) return;
+    if ( ! nvImageLoaded) {
+        memcpy(nvImage, nodeVarTable.nodeVars, NV_NUM);
+        nvImageLoaded = TRUE;
+    }
+    nvImage[a - AT_NV - 1] = data;
+    nvImageDirty = TRUE;
+}
+
+void flushFlashImage(void) {
+    if (nvImageDirty) {
+        // the host build of mioNv.c defines the table in RAM
+        memcpy((BYTE *)nodeVarTable.nodeVars, nvImage, NV_NUM);
+        nvImageDirty = FALSE;
+        hostFlashWrites++;
+    }
+}
+
+unsigned int getNodeVar(unsigned int index) {
+    return ((index == 0) || (index > NV_NUM)) ? 0 : nodeVarTable.nodeVars[index-1];
+}
+
+/*
+ * Event table
+ */
+typedef struct {
+    BOOL valid;
+    WORD nn;
+    WORD en;
+    BYTE evs[EVperEVT];
+} HostEvent;
+
+static HostEvent events[NUM_CONSUMED_EVENTS];
+static Event producedEvents[NUM_ACTIONS];
+static BOOL produced[NUM_ACTIONS];
+
+void hostClearEvents(void) {
+    memset(events, 0, sizeof(events));
+    memset(produced, 0, sizeof(produced));
+}
+
+/**
+ * Add a consumed event to the table.
+ * @param nn the event NN, 0 for a short event
+ * @param en the event EN
+ * @param evs the actions
+ * @param numEvs the number of actions, up to EVperEVT
+ * @return the table index or 0xFF if the table is full
+ */
+BYTE hostTeachEvent(WORD nn, WORD en, const BYTE * evs, BYTE numEvs) {
+    BYTE i;
+
+    for (i=0; i<NUM_CONSUMED_EVENTS; i++) {
+        if ( ! events[i].valid) {
+            events[i].valid = TRUE;
+            events[i].nn = nn;
+            events[i].en = en;
+            memset(events[i].evs, NO_ACTION, EVperEVT);
+            memcpy(events[i].evs, evs, (numEvs < EVperEVT) ? numEvs : EVperEVT);
+            return i;
+        }
+    }
+    return 0xFF;
+}
+
+void hostSetProducedEvent(BYTE action, WORD nn, WORD en) {
+    producedEvents[action].NN = nn;
+    producedEvents[action].EN = en;
+    produced[action] = TRUE;
+}
+
+BOOL validStart(BYTE tableIndex) {
+    return (tableIndex < NUM_CONSUMED_EVENTS) && events[tableIndex].valid;
+}
+
+WORD getNN(BYTE tableIndex) {
+    return events[tableIndex].nn;
+}
+
+WORD getEN(BYTE tableIndex) {
+    return events[tableIndex].en;
+}
+
+int getEv(BYTE tableIndex, BYTE evIndex) {
+    if ( ! validStart(tableIndex) || (evIndex >= EVperEVT)) return -1;
+    return events[tableIndex].evs[evIndex];
+}
+
+void doEvlrn(WORD nn, WORD en, BYTE evNum, BYTE evVal) {
+    BYTE i;
+
+    if (evVal < ACTION_CONSUMER_BASE) {
+        hostSetProducedEvent(evVal, nn, en);
+        return;
+    }
+    if (evNum == 0) {
+        hostTeachEvent(nn, en, &evVal, 1);
+        return;
+    }
+    // a later EV goes in the last entry for the event
+    for (i=NUM_CONSUMED_EVENTS; i--; ) {
+        if (events[i].valid && (events[i].nn == nn) && (events[i].en == en)) {
+            if (evNum < EVperEVT) events[i].evs[evNum] = evVal;
+            return;
+        }
+    }
+}
+
+void deleteAction(BYTE action) {
+    BYTE i;
+
+    if (action < ACTION_CONSUMER_BASE) {
+        produced[action] = FALSE;
+        return;
+    }
+    for (i=0; i<NUM_CONSUMED_EVENTS; i++) {
+        if (events[i].valid && (events[i].evs[0] == action)) {
+            events[i].valid = FALSE;
+        }
+    }
+}
+
+const Event * getProducedEvent(BYTE action) {
+    return ((action < NUM_ACTIONS) && produced[action]) ? &producedEvents[action] : NULL;
+}
+
+/*
+ * CBUS
+ */
+BOOL cbusSendEvent(BYTE cbusNum, WORD nodeNumber, WORD eventNumber, BOOL onEvent) {
+    if (hostTxFull) return FALSE;
+    hostSentCount++;
+    if (hostSent != NULL) hostSent(nodeNumber, eventNumber, onEvent);
+    return TRUE;
+}
+
+void cbusSendOpcMyNN(BYTE cbusNum, BYTE opc, BYTE * msg) {
+    memcpy(hostReply, msg, sizeof(hostReply));
+    hostReply[d0] = opc;
+}
+
+BOOL thisNN(BYTE * msg) {
+    return (((WORD)msg[d1] << 8) | msg[d2]) == ee_read_short((WORD)EE_NODE_ID);
+}
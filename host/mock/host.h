@@ -0,0 +1,59 @@
+/*
+ * File:   host.h
+ * Author: Ian
+ *
+ * The host harness. The drivers use this to play the part of the hardware and
+ * the rest of the CBUS, and to run the module's main loop one pass at a time.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef HOST_H
+#define	HOST_H
+
+#include "CBUSlib/GenericTypeDefs.h"
+
+#define HOST_TMR1_PER_TICK  64      // TMR1 counts 0.25us, a tick is 16us
+#define HOST_NN             256     // the module NN
+
+    /*
+     * Hardware, in sfr.c
+     */
+    extern void hostEepromStep(void);
+    extern void hostEndServoPulses(void);
+
+    /*
+     * The library, in cbuslib.c
+     */
+    extern DWORD hostTicks;
+    extern void hostAdvance(DWORD ticks);
+    extern void hostClearEvents(void);
+    extern BYTE hostTeachEvent(WORD nn, WORD en, const BYTE * evs, BYTE numEvs);
+    extern void hostSetProducedEvent(BYTE action, WORD nn, WORD en);
+
+    typedef void (*HostSentFunction)(WORD nn, WORD en, BOOL on);
+    extern HostSentFunction hostSent;    // called for each event sent, may be NULL
+    extern DWORD hostSentCount;
+    extern BOOL hostTxFull;             // the CAN driver has no TX space
+    extern WORD hostFlashWrites;        // Flash image flushes which wrote the NVs
+    extern BYTE hostReply[8];           // the last message sent with cbusSendOpcMyNN
+
+    /*
+     * The module, in module.c
+     */
+    extern void hostInit(void);
+    extern void hostStart(void);
+    extern void hostLoop(void);
+    extern void hostReceive(BYTE opc, WORD nn, WORD en);
+    extern void setType(unsigned char i, unsigned char type);
+
+    /*
+     * servo.c has no header
+     */
+    extern void startServos(void);
+    extern void channel0DoneInterruptHandler(void);
+    extern void channel1DoneInterruptHandler(void);
+    extern void channel2DoneInterruptHandler(void);
+    extern void channel3DoneInterruptHandler(void);
+
+#endif	/* HOST_H */
@@ -0,0 +1,156 @@
+/*
+ * File:   module.c
+ * Author: Ian
+ *
+ * The parts of main.c which the rest of the module uses, for the host build.
+ * main.c itself is left out as it holds the ISRs and the reset vector. The
+ * initialisation and main loop are the same as main.c without the CAN driver,
+ * the FLiM switch and status LEDs, and the startup delay is up to the driver.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <stddef.h>
+#include <xc.h>
+#include "CBUSlib/GenericTypeDefs.h"
+#include "CBUSlib/EEPROM.h"
+#include "CBUSlib/TickTime.h"
+#include "CBUSlib/events.h"
+#include "CBUSlib/FLiM.h"
+#include "module.h"
+#include "canmio.h"
+#include "mioNv.h"
+#include "mioEEPROM.h"
+#include "mioEvents.h"
+#include "inputs.h"
+#include "txQueue.h"
+#include "eventIndex.h"
+#include "scheduler.h"
+#include "actionQueue.h"
+#include "stateStore.h"
+#include "ioCache.h"
+#include "idle.h"
+#include "perf.h"
+#include "canFilters.h"
+#include "stateReport.h"
+#include "host.h"
+
+extern void initServos(void);
+extern void pollServos(void);
+extern void resetServo(unsigned char io);
+extern void restoreOutputs(void);
+extern void setOutputPin(unsigned char io, BOOL state);
+
+void sendProducedEvent(unsigned char action, BOOL on);
+
+/**
+ * Initialise everything in the same order as main.c.
+ */
+void hostInit(void) {
+    BYTE io;
+
+    ANCON0 = 0;
+    ANCON1 = 0;
+    if (ee_read((WORD)EE_RESET) != 0xCA) {
+        ee_write((WORD)EE_FLIM_MODE, fsFLiM);
+        ee_write_short((WORD)EE_NODE_ID, HOST_NN);
+        ee_write((WORD)EE_NV_VERSION, NV_VERSION);
+        ee_write((WORD)EE_RESET, 0xCA);
+    }
+    upgradeNVs();
+    WPUB = 0x33;
+    buildIoCache();
+    initTxQueue();
+    rebuildEventIndex();
+    rebuildCanFilters();
+    initActionQueue();
+    initStateStore();
+    for (io=0; io<NUM_IO; io++) {
+        if (nodeVarTable.moduleNVs.io[io].type == TYPE_OUTPUT) {
+            setOutputPin(io, nodeVarTable.moduleNVs.io[io].nv_io.nv_output.outout_inverted);
+        }
+    }
+    initScheduler();
+    addTask(pollActionQueue, 0);
+    addTask(pollStateStore, 0);
+    addTask(pollNvTransaction, 0);
+    addTask(pollStateReport, 0);
+    initInputScan();
+    initServos();
+    initIdle();
+    resetPerf();
+}
+
+/**
+ * The end of the startup delay, the same as main.c.
+ */
+void hostStart(void) {
+    addTask(pollInputs, 0);
+    addTask(inputScan, INPUT_SCAN_PERIOD);
+    servoStartTask = addTask(startServos, 5*ONE_MILI_SECOND);
+    servoPollTask = addTask(pollServos, 20*ONE_MILI_SECOND);
+    restoreOutputs();
+}
+
+/**
+ * One pass of the main loop. Any servo pulse started in the pass is ended
+ * and any EEPROM write is completed before returning.
+ */
+void hostLoop(void) {
+    perfLoopStart();
+    txQueueDrain();
+    runTasks();
+    pollLoopback();
+    perfLoopEnd();
+    hostEndServoPulses();
+    hostEepromStep();
+}
+
+/**
+ * Receive an accessory event from the CBUS, as receiveCBUS() does.
+ * @param opc the event opcode
+ * @param nn the event NN
+ * @param en the event EN
+ */
+void hostReceive(BYTE opc, WORD nn, WORD en) {
+    BYTE msg[8];
+
+    msg[d0] = opc;
+    msg[d1] = nn >> 8;
+    msg[d2] = nn & 0xFF;
+    msg[d3] = en >> 8;
+    msg[d4] = en & 0xFF;
+    PERF_INC(perf.canRx);
+    if (IS_EVENT_OPC(opc) && (flimState != fsFLiMLearn)) {
+        dispatchEvent(msg);
+    }
+}
+
+/**
+ * Set the Type of the IO, the same as main.c.
+ * @param i the IO
+ * @param type the new Type
+ */
+void setType(unsigned char i, unsigned char type) {
+    resetServo(i);
+    writeNV(NV_IO_TYPE(i), type);
+    defaultNVs(i, type);
+    defaultEvents(i, type);
+}
+
+/**
+ * Send a Produced event, the same as main.c.
+ * @param action the produced action
+ * @param on TRUE for an ON event
+ */
+void sendProducedEvent(unsigned char action, BOOL on) {
+    const Event * ev = getProducedEvent(action);
+    if (ev != NULL) {
+        if ((action >= ACTION_PRODUCER_BASE) && (typeMask[TYPE_INPUT] & IO_BIT(PRODUCER_IO(action)))) {
+            txQueueEvent(TX_PRIORITY_HIGH, ev->NN, ev->EN, on);
+        } else {
+            txQueueEvent(TX_PRIORITY_LOW, ev->NN, ev->EN, on);
+        }
+        loopbackEvent(ev->NN, ev->EN, on);
+    }
+}
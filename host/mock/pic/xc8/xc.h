@@ -0,0 +1,232 @@
+/*
+ * File:   xc.h
+ * Author: Ian
+ *
+ * Mock of the XC8 device header for the host build. The special function
+ * registers used by the module are plain variables, defined in sfr.c, so the
+ * module code compiles and runs unchanged with a host compiler. Registers
+ * which alias each other on the PIC, e.g. INTCON and INTCONbits, are separate
+ * here. Only the registers and bits the module uses are mocked.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef XC_H
+#define	XC_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define _PIC18F25K80_H_
+#define HOST_BUILD
+
+    typedef volatile unsigned char SFR;
+    typedef volatile unsigned short SFR16;
+
+    /*
+     * Ports
+     */
+    extern SFR PORTA, PORTB, PORTC;
+    extern SFR LATA, LATB, LATC;
+    extern SFR TRISA, TRISB, TRISC;
+    extern SFR WPUB, IOCB, ANCON0, ANCON1;
+
+    /*
+     * Timer 1 and the ECCP1/CCP2..5 compare registers
+     */
+    extern SFR16 TMR1;
+    extern SFR16 CCPR1, CCPR2, CCPR3, CCPR4, CCPR5;
+    extern SFR CCP1CON, CCP2CON, CCP3CON, CCP4CON, CCP5CON;
+
+    typedef struct {
+        unsigned TMR1ON:1;
+        unsigned RD16:1;
+        unsigned SOSCEN:1;
+        unsigned :1;
+        unsigned T1CKPS:2;
+        unsigned TMR1CS:2;
+    } T1CONbits_t;
+    extern volatile T1CONbits_t T1CONbits;
+    typedef struct {
+        unsigned :7;
+        unsigned TMR1GE:1;
+    } T1GCONbits_t;
+    extern volatile T1GCONbits_t T1GCONbits;
+    typedef struct {
+        unsigned C1TSEL:1;
+        unsigned C2TSEL:1;
+        unsigned C3TSEL:1;
+        unsigned C4TSEL:1;
+        unsigned C5TSEL:1;
+        unsigned :3;
+    } CCPTMRSbits_t;
+    extern volatile CCPTMRSbits_t CCPTMRSbits;
+
+    /*
+     * Interrupts
+     */
+    typedef struct {
+        unsigned RBIF:1;
+        unsigned INT0IF:1;
+        unsigned TMR0IF:1;
+        unsigned RBIE:1;
+        unsigned INT0IE:1;
+        unsigned TMR0IE:1;
+        unsigned GIEL:1;
+        unsigned GIEH:1;
+    } INTCONbits_t;
+    typedef union {
+        unsigned char byte;
+        INTCONbits_t bits;
+    } INTCON_t;
+    extern volatile INTCON_t hostIntcon;
+#define INTCON      hostIntcon.byte
+#define INTCONbits  hostIntcon.bits
+    typedef struct {
+        unsigned RBIP:1;
+        unsigned :1;
+        unsigned TMR0IP:1;
+        unsigned :1;
+        unsigned INTEDG2:1;
+        unsigned INTEDG1:1;
+        unsigned INTEDG0:1;
+        unsigned RBPU:1;
+    } INTCON2bits_t;
+    extern volatile INTCON2bits_t INTCON2bits;
+    typedef struct {
+        unsigned INT1IF:1;
+        unsigned INT2IF:1;
+        unsigned INT3IF:1;
+        unsigned INT1IE:1;
+        unsigned INT2IE:1;
+        unsigned INT3IE:1;
+        unsigned INT1IP:1;
+        unsigned INT2IP:1;
+    } INTCON3bits_t;
+    extern volatile INTCON3bits_t INTCON3bits;
+    typedef struct {
+        unsigned TMR1IE:1;
+        unsigned :7;
+    } PIE1bits_t;
+    extern volatile PIE1bits_t PIE1bits;
+    typedef struct {
+        unsigned :1;
+        unsigned CCP1IE:1;
+        unsigned CCP2IE:1;
+        unsigned :5;
+    } PIE3bits_t;
+    extern volatile PIE3bits_t PIE3bits;
+    typedef struct {
+        unsigned :1;
+        unsigned CCP1IF:1;
+        unsigned CCP2IF:1;
+        unsigned :5;
+    } PIR3bits_t;
+    extern volatile PIR3bits_t PIR3bits;
+    typedef struct {
+        unsigned :1;
+        unsigned CCP1IP:1;
+        unsigned CCP2IP:1;
+        unsigned :5;
+    } IPR3bits_t;
+    extern volatile IPR3bits_t IPR3bits;
+    typedef struct {
+        unsigned CCP3IE:1;
+        unsigned CCP4IE:1;
+        unsigned CCP5IE:1;
+        unsigned :5;
+    } PIE4bits_t;
+    extern volatile PIE4bits_t PIE4bits;
+    typedef struct {
+        unsigned CCP3IF:1;
+        unsigned CCP4IF:1;
+        unsigned CCP5IF:1;
+        unsigned :5;
+    } PIR4bits_t;
+    extern volatile PIR4bits_t PIR4bits;
+    typedef struct {
+        unsigned CCP3IP:1;
+        unsigned CCP4IP:1;
+        unsigned CCP5IP:1;
+        unsigned :5;
+    } IPR4bits_t;
+    extern volatile IPR4bits_t IPR4bits;
+    typedef struct {
+        unsigned IPEN:1;
+        unsigned :7;
+    } RCONbits_t;
+    extern volatile RCONbits_t RCONbits;
+
+    /*
+     * Oscillator
+     */
+    typedef struct {
+        unsigned :7;
+        unsigned IDLEN:1;
+    } OSCCONbits_t;
+    extern volatile OSCCONbits_t OSCCONbits;
+    typedef struct {
+        unsigned :6;
+        unsigned PLLEN:1;
+        unsigned :1;
+    } OSCTUNEbits_t;
+    extern volatile OSCTUNEbits_t OSCTUNEbits;
+
+    /*
+     * Data EEPROM. A write started with WR is completed by hostEepromStep().
+     */
+    extern SFR EEADR, EEADRH, EEDATA, EECON2;
+    typedef struct {
+        unsigned RD:1;
+        unsigned WR:1;
+        unsigned WREN:1;
+        unsigned WRERR:1;
+        unsigned FREE:1;
+        unsigned :1;
+        unsigned CFGS:1;
+        unsigned EEPGD:1;
+    } EECON1bits_t;
+    extern volatile EECON1bits_t EECON1bits;
+
+    /*
+     * ECAN. The filters and masks are 4 consecutive registers each, as on the
+     * PIC, and CANSTAT follows the mode requested in CANCON at once.
+     */
+    extern SFR CANCON, ECANCON, COMSTAT, SDFLC;
+    extern SFR MSEL0, MSEL1, MSEL2, MSEL3, RXFCON0, RXFCON1;
+#define CANSTAT     CANCON
+    extern SFR hostCanFilters[18][4];
+#define RXF0SIDH    hostCanFilters[0][0]
+#define RXF1SIDH    hostCanFilters[1][0]
+#define RXF2SIDH    hostCanFilters[2][0]
+#define RXF3SIDH    hostCanFilters[3][0]
+#define RXF4SIDH    hostCanFilters[4][0]
+#define RXF5SIDH    hostCanFilters[5][0]
+#define RXF6SIDH    hostCanFilters[6][0]
+#define RXF7SIDH    hostCanFilters[7][0]
+#define RXF8SIDH    hostCanFilters[8][0]
+#define RXF9SIDH    hostCanFilters[9][0]
+#define RXF10SIDH   hostCanFilters[10][0]
+#define RXF11SIDH   hostCanFilters[11][0]
+#define RXF12SIDH   hostCanFilters[12][0]
+#define RXF13SIDH   hostCanFilters[13][0]
+#define RXF14SIDH   hostCanFilters[14][0]
+#define RXF15SIDH   hostCanFilters[15][0]
+#define RXM0SIDH    hostCanFilters[16][0]
+#define RXM1SIDH    hostCanFilters[17][0]
+
+    /*
+     * Instructions
+     */
+#define Sleep()
+#define Nop()
+#define ClrWdt()
+#define ei()        (INTCONbits.GIEH = 1, INTCONbits.GIEL = 1)
+#define di()        (INTCONbits.GIEH = 0, INTCONbits.GIEL = 0)
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* XC_H */
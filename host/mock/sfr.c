@@ -0,0 +1,75 @@
+/*
+ * File:   sfr.c
+ * Author: Ian
+ *
+ * The special function registers of the mock xc.h, as plain variables. The
+ * host harness plays the part of the hardware, e.g. completing EEPROM writes
+ * and ending servo pulses.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "CBUSlib/EEPROM.h"
+#include "host.h"
+
+SFR PORTA, PORTB, PORTC;
+SFR LATA, LATB, LATC;
+SFR TRISA, TRISB, TRISC;
+SFR WPUB, IOCB, ANCON0, ANCON1;
+
+SFR16 TMR1;
+SFR16 CCPR1, CCPR2, CCPR3, CCPR4, CCPR5;
+SFR CCP1CON, CCP2CON, CCP3CON, CCP4CON, CCP5CON;
+volatile T1CONbits_t T1CONbits;
+volatile T1GCONbits_t T1GCONbits;
+volatile CCPTMRSbits_t CCPTMRSbits;
+
+volatile INTCON_t hostIntcon;
+volatile INTCON2bits_t INTCON2bits;
+volatile INTCON3bits_t INTCON3bits;
+volatile PIE1bits_t PIE1bits;
+volatile PIE3bits_t PIE3bits;
+volatile PIR3bits_t PIR3bits;
+volatile IPR3bits_t IPR3bits;
+volatile PIE4bits_t PIE4bits;
+volatile PIR4bits_t PIR4bits;
+volatile IPR4bits_t IPR4bits;
+volatile RCONbits_t RCONbits;
+
+volatile OSCCONbits_t OSCCONbits;
+volatile OSCTUNEbits_t OSCTUNEbits;
+
+SFR EEADR, EEADRH, EEDATA, EECON2;
+volatile EECON1bits_t EECON1bits;
+
+SFR CANCON, ECANCON, COMSTAT, SDFLC;
+SFR MSEL0, MSEL1, MSEL2, MSEL3, RXFCON0, RXFCON1;
+SFR hostCanFilters[18][4];
+
+/**
+ * Complete a data EEPROM read or write started through EECON1.
+ */
+void hostEepromStep(void) {
+    WORD addr = ((WORD)EEADRH << 8) | EEADR;
+
+    if (EECON1bits.RD) {
+        EEDATA = ee_read(addr);
+        EECON1bits.RD = 0;
+    }
+    if (EECON1bits.WR) {
+        ee_write(addr, EEDATA);
+        EECON1bits.WR = 0;
+    }
+}
+
+/**
+ * End the servo pulses which are in progress, as the CCP compare interrupts
+ * would when Timer1 reaches the end of each pulse.
+ */
+void hostEndServoPulses(void) {
+    if (PIE3bits.CCP2IE) channel0DoneInterruptHandler();
+    if (PIE4bits.CCP3IE) channel1DoneInterruptHandler();
+    if (PIE4bits.CCP4IE) channel2DoneInterruptHandler();
+    if (PIE4bits.CCP5IE) channel3DoneInterruptHandler();
+}
@@ -0,0 +1,204 @@
+/*
+ * File:   replay.c
+ * Author: Ian
+ *
+ * Replay recorded CBUS traffic into the module on the host and report the
+ * latency diagnostics as the module would over RDGN. The main loop is run
+ * between the frames with time moving on by a fixed amount each pass, so the
+ * latencies are those of the module's own scheduling, not of the PIC's speed.
+ *
+ *   replay [-p pass_us] trace
+ *
+ * A trace is text, one item per line, # starts a comment. The module is set
+ * up by the lines before the first frame:
+ *   type <io> <type>               set the Type of an IO, 0 input .. 4 multi
+ *   nv <index> <value>             set an NV
+ *   teach <nn> <en> <action>...    teach a consumed event with its actions
+ *   produce <action> <nn> <en>     teach a produced event
+ * then each frame is the time in ms from the start and the frame in the
+ * GridConnect form used by CAN-USB logs, e.g.
+ *   1500 :SB020N9001020003;
+ *
+ * Created on 14 October 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xc.h>
+#include "CBUSlib/GenericTypeDefs.h"
+#include "CBUSlib/TickTime.h"
+#include "CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "mioEvents.h"
+#include "eventIndex.h"
+#include "perf.h"
+#include "host.h"
+
+#define DEFAULT_PASS_US     250
+#define RUN_ON_MS           2000    // time after the last frame for the outputs to settle
+
+static DWORD passTicks;
+static BOOL started;
+static unsigned long frames;
+static unsigned long lineNum;
+
+static void failed(const char * why) {
+    fprintf(stderr, "line %lu: %s\n", lineNum, why);
+    exit(1);
+}
+
+static DWORD msTicks(unsigned long ms) {
+    return (DWORD)((unsigned long long)ms * ONE_SECOND / 1000);
+}
+
+/**
+ * Run main loop passes until the time.
+ */
+static void runUntil(DWORD ticks) {
+    while ((long)(ticks - hostTicks) > 0) {
+        hostAdvance(passTicks);
+        hostLoop();
+    }
+}
+
+/**
+ * The end of the setup lines. The NVs are committed and the startup delay is
+ * over. Time hasn't moved during the setup so the trace times are from when
+ * the module starts running.
+ */
+static void start(void) {
+    commitNvTransaction();
+    rebuildEventIndex();
+    hostStart();
+    started = TRUE;
+}
+
+/**
+ * Parse a GridConnect frame, :S<SID>N<data>; and receive it.
+ */
+static void frame(const char * gc) {
+    BYTE data[8];
+    BYTE len;
+    unsigned int b;
+    const char * p;
+
+    if ((gc[0] != ':') || (gc[1] != 'S')) failed("not a standard frame");
+    p = strchr(gc, 'N');
+    if (p == NULL) failed("not a data frame");
+    memset(data, 0, sizeof(data));
+    for (p++, len=0; (len < sizeof(data)) && (sscanf(p, "%2x", &b) == 1); p += 2, len++) {
+        data[len] = b;
+    }
+    if (*p != ';') failed("bad frame data");
+    if (len == 0) return;
+    frames++;
+    hostReceive(data[d0], ((WORD)data[d1] << 8) | data[d2], ((WORD)data[d3] << 8) | data[d4]);
+}
+
+static void setupLine(char * cmd, char * args) {
+    unsigned int a[2 + EVperEVT];
+    BYTE evs[EVperEVT];
+    int n;
+    int i;
+    char * tok;
+
+    n = 0;
+    for (tok = strtok(args, " \t"); (tok != NULL) && (n < 2 + EVperEVT); tok = strtok(NULL, " \t")) {
+        a[n++] = strtoul(tok, NULL, 0);
+    }
+    if (started) failed("setup after the first frame");
+    if ((strcmp(cmd, "type") == 0) && (n == 2)) {
+        if ((a[0] >= NUM_IO) || (a[1] > TYPE_MULTI)) failed("bad type");
+        setType(a[0], a[1]);
+    } else if ((strcmp(cmd, "nv") == 0) && (n == 2)) {
+        if ( ! setNvPending(a[0], a[1])) failed("bad NV");
+    } else if ((strcmp(cmd, "teach") == 0) && (n >= 3)) {
+        for (i=2; i<n; i++) evs[i-2] = a[i];
+        if (hostTeachEvent(a[0], a[1], evs, n-2) == 0xFF) failed("event table full");
+    } else if ((strcmp(cmd, "produce") == 0) && (n == 3)) {
+        if (a[0] >= ACTION_CONSUMER_BASE) failed("not a produced action");
+        hostSetProducedEvent(a[0], a[1], a[2]);
+    } else {
+        failed("unknown line");
+    }
+}
+
+/**
+ * @return a diagnostic value as the module replies to RDGN
+ */
+static WORD diagnostic(BYTE code) {
+    BYTE msg[8];
+
+    memset(msg, 0, sizeof(msg));
+    msg[d0] = OPC_RDGN;
+    msg[d4] = code;
+    perfRequest(msg);
+    return ((WORD)hostReply[d5] << 8) | hostReply[d6];
+}
+
+static void report(void) {
+    static const char * bins[PERF_LATENCY_BINS] = {"<1", "<2", "<5", "<10", "<20", "<50", ">=50"};
+    unsigned char i;
+
+    printf("%lu frames, %u events consumed, %u not consumed, %u events sent\n",
+            frames, diagnostic(PERF_LOOKUP_HIT), diagnostic(PERF_LOOKUP_MISS), diagnostic(PERF_CAN_TX));
+    printf("event to output latency:\n");
+    for (i=0; i<PERF_LATENCY_BINS; i++) {
+        printf("  %4s ms %6u\n", bins[i], diagnostic(PERF_LATENCY_HIST+i));
+    }
+    printf("  worst %u ms\n", diagnostic(PERF_LATENCY_MAX));
+    printf("TX queue overflows %u, input chatter %u, looped back %u\n",
+            diagnostic(PERF_TX_OVERFLOW), diagnostic(PERF_INPUT_CHATTER), diagnostic(PERF_LOOPBACK));
+    printf("servo frame and motion deadlines missed %u %u\n",
+            diagnostic(PERF_SERVO_START_MISSED), diagnostic(PERF_SERVO_POLL_MISSED));
+}
+
+int main(int argc, char ** argv) {
+    FILE * f;
+    char line[256];
+    char * cmd;
+    char * rest;
+    unsigned long passUs = DEFAULT_PASS_US;
+    int arg = 1;
+
+    if ((argc > 2) && (strcmp(argv[1], "-p") == 0)) {
+        passUs = strtoul(argv[2], NULL, 0);
+        arg = 3;
+    }
+    if ((arg != argc - 1) || (passUs == 0)) {
+        fprintf(stderr, "usage: replay [-p pass_us] trace\n");
+        return 2;
+    }
+    f = fopen(argv[arg], "r");
+    if (f == NULL) {
+        perror(argv[arg]);
+        return 1;
+    }
+    passTicks = passUs * ONE_SECOND / 1000000;
+    if (passTicks == 0) passTicks = 1;
+
+    hostInit();
+    beginNvTransaction();
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineNum++;
+        if ((rest = strchr(line, '#')) != NULL) *rest = '\0';
+        cmd = strtok(line, " \t\r\n");
+        if (cmd == NULL) continue;
+        rest = strtok(NULL, "\r\n");
+        if (rest == NULL) rest = "";
+        if ((cmd[0] >= '0') && (cmd[0] <= '9')) {
+            if ( ! started) start();
+            while (*rest == ' ' || *rest == '\t') rest++;
+            runUntil(msTicks(strtoul(cmd, NULL, 10)));
+            frame(rest);
+        } else {
+            setupLine(cmd, rest);
+        }
+    }
+    fclose(f);
+    if ( ! started) start();
+    runUntil(hostTicks + msTicks(RUN_ON_MS));
+    report();
+    return 0;
+}
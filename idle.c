@@ -0,0 +1,95 @@
+/* 
+ * File:   idle.c
+ * Author: Ian
+ * 
+ * Put the CPU into IDLE when there is nothing to do. In IDLE the CPU stops
+ * but the oscillator and peripherals keep running, so the servo pulse 
+ * compares, CAN reception and the timers carry on as normal.
+ * 
+ * IDLE is only entered, if enabled by NV_FLAG_IDLE, when no CAN message was
+ * processed on this pass, no produced events are waiting, no servo is 
+ * generating pulses (so the servo frame timing is unchanged) and no output 
+ * pulse or flash is pending. It is left on any interrupt: CAN
+ * RX, the tick, the fast input changes and the 1ms ECCP1 compare on TMR1
+ * which keeps the scheduler running. The compare interrupt is only enabled
+ * whilst NV_FLAG_IDLE is set.
+ * 
+ * Only the low priority interrupts are disabled around the SLEEP so the 
+ * high priority servo pulse interrupts are serviced straight from IDLE. A low
+ * priority interrupt that arrives after the check still wakes the CPU because
+ * its flag is set, and is serviced as soon as low priority interrupts are
+ * enabled again, so CAN reception isn't delayed.
+ * 
+ * The percentage of each second spent in IDLE is recorded in idleStats.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/TickTime.h"
+#include "../../CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "ioCache.h"
+#include "txQueue.h"
+#include "idle.h"
+
+IdleStats idleStats;
+volatile BOOL idleWake;
+
+void initIdle(void) {
+    idleStats.idleTime = 0;
+    idleStats.windowStart = tickGet();
+    idleStats.dutyCycle = 0;
+    idleWake = FALSE;
+    
+    // ECCP1 compare with TMR1, software interrupt on match
+    CCPTMRSbits.C1TSEL = 0;
+    CCP1CON = 0x0A;
+    IPR3bits.CCP1IP = 0;        // low priority
+    PIE3bits.CCP1IE = 0;
+    setupIdleTick();
+}
+
+void setupIdleTick(void) {
+    if (nodeVarTable.moduleNVs.flags & NV_FLAG_IDLE) {
+        if (PIE3bits.CCP1IE) return;    // already running
+        CCPR1 = TMR1 + IDLE_TICK;
+        PIR3bits.CCP1IF = 0;
+        PIE3bits.CCP1IE = 1;
+    } else {
+        // nothing to wake from so don't interrupt every 1ms
+        PIE3bits.CCP1IE = 0;
+        PIR3bits.CCP1IF = 0;
+    }
+}
+
+void idleTickInterruptHandler(void) {
+    CCPR1 += IDLE_TICK;
+    PIR3bits.CCP1IF = 0;
+}
+
+void idleIfQuiet(BOOL busy) {
+    DWORD now;
+    DWORD window;
+    
+    now = tickGet();
+    window = now - idleStats.windowStart;
+    if (window >= ONE_SECOND) {
+        idleStats.dutyCycle = (BYTE)((idleStats.idleTime * 100) / window);
+        idleStats.idleTime = 0;
+        idleStats.windowStart = now;
+    }
+    if ( ! (nodeVarTable.moduleNVs.flags & NV_FLAG_IDLE)) return;
+    if (busy || servoOnMask || pulsingMask) return;
+    if ( ! txQueueEmpty()) return;
+    
+    INTCONbits.GIEL = 0;
+    if ( ! idleWake) {
+        OSCCONbits.IDLEN = 1;   // SLEEP enters IDLE, peripherals keep running
+        Sleep();
+        idleStats.idleTime += tickGet() - now;
+    }
+    idleWake = FALSE;
+    INTCONbits.GIEL = 1;
+}
@@ -0,0 +1,53 @@
+/* 
+ * File:   idle.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef IDLE_H
+#define	IDLE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+#define IDLE_TICK           4000    // CCP1 wake up interval in TMR1 counts, 1ms
+
+    typedef struct {
+        DWORD idleTime;         // ticks spent in IDLE in the current window
+        DWORD windowStart;
+        BYTE dutyCycle;         // percentage of the last second spent in IDLE
+    } IdleStats;
+    
+    extern IdleStats idleStats;
+    /**
+     * Set by the low priority ISR, tells the main loop not to enter IDLE as 
+     * there may be new work.
+     */
+    extern volatile BOOL idleWake;
+
+    extern void initIdle(void);
+    /**
+     * Enable the 1ms wake up compare if NV_FLAG_IDLE is set, otherwise disable
+     * it. Called when NV_FLAGS may have changed.
+     */
+    extern void setupIdleTick(void);
+    /**
+     * Enter IDLE until the next interrupt if there is nothing to do.
+     * @param busy TRUE if a CAN message was processed on this pass of the loop
+     */
+    extern void idleIfQuiet(BOOL busy);
+    /**
+     * The 1ms wake up compare. Called from the low priority ISR.
+     */
+    extern void idleTickInterruptHandler(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* IDLE_H */
+
@@ -5,6 +5,35 @@
  * Handle in input Type variant of the IO. Scan for changes in state and 
  * generate Produced events.
  *
+ * The inputs are scanned in parallel. Each pass reads PORTA, PORTB and PORTC
+ * once and the debounce is performed on all the bits of a port at once using
+ * a 2 bit vertical counter per bit (two bit planes count0/count1). A bit's
+ * debounced state only changes once the input has been different for 4
+ * consecutive scans. An XOR of the debounced and reported state then gives the
+ * set of inputs which have changed, so only those need any per IO work.
+ *
+ * The scan is run by the scheduler every INPUT_SCAN_PERIOD against absolute 
+ * deadlines so the input_on_delay/input_off_delay NVs are in ms regardless of
+ * how long the rest of the main loop takes.
+ * 
+ * Optionally (NV_FLAG_FAST_INPUTS) inputs on RB0, RB1, RB4 and RB5 use the 
+ * INT0, INT1 and interrupt on change hardware. The edge is timestamped in the 
+ * ISR and then bypasses the vertical counter at the next main loop pass. The
+ * input is then locked out of the fast path for FAST_LOCKOUT from the edge, 
+ * so the bounces of a contact go through the vertical counter debounce 
+ * instead of each sending an event.
+ * 
+ * Each input has a token bucket rate limit (NV_INPUT_REFILL, NV_INPUT_BURST)
+ * so a faulty detector can't flood the bus. An input can send a burst of
+ * inputBurst events and then earns another event every inputRefill*10ms. A
+ * change with no token left is held back and merged with any later changes
+ * so once a token is earned only the latest state is sent, or nothing if the
+ * input has gone back to the reported state. The first held change sends the
+ * INPUT_CHATTER ON event, and the OFF event is sent once the bucket is full
+ * again and the input has made no change for CHATTER_HOLD, so an input which
+ * chatters in bursts doesn't send an ON and OFF pair for each burst. Held
+ * changes are counted in perf.inputChatter.
+ *
  * Created on 17 April 2017, 13:14
  */
 
@@ -13,22 +42,96 @@
 #include "canmio.h"
 #include "mioNv.h"
 #include "config.h"
+#include "pinmap.h"
 #include "../../CBUSlib/FLiM.h"
+#include "../../CBUSlib/TickTime.h"
+#include "ioCache.h"
+#include "perf.h"
 
 extern const NodeVarTable nodeVarTable;
-extern Config configs[NUM_IO];
-/**
- * The current state of the inputs. This may not be the actual read state uas we
- * could still be doing the debounce. Instead this is the currently reported input state.
+extern PinPort pinPorts[NUM_IO];
+extern void sendProducedEvent(unsigned char action, BOOL on);
+
+#define NO_IO       0xFF
+
+#define FAST_INPUT_BITS     0x33    // RB0, RB1, RB4, RB5 can use the fast path
+#define FAST_EDGE_INDEX(b)  (((b) & 1) | (((b) >> 1) & 2))
+#define FAST_LOCKOUT        (20*ONE_MILI_SECOND)
+#define CHATTER_HOLD        (5*ONE_SECOND)  // no changes for this long before INPUT_CHATTER OFF
+
+/*
+ * Per port mask of the bits which are configured as inputs and of the bits 
+ * which are inverted. Rebuilt from the NVs by buildInputMasks().
+ */
+static BYTE inputMask[NUM_PORTS];
+static BYTE invertMask[NUM_PORTS];
+/*
+ * The debounced state of each input bit. This may not yet be the reported 
+ * state as we could still be waiting for the input_on_delay/input_off_delay.
+ */
+static BYTE debounced[NUM_PORTS];
+/*
+ * The vertical debounce counters. Bit n of count0 and count1 form a 2 bit 
+ * counter for bit n of the port.
+ */
+static BYTE count0[NUM_PORTS];
+static BYTE count1[NUM_PORTS];
+/*
+ * The currently reported input state, after inversion.
  */
-static BYTE inputState[NUM_IO];
+static BYTE reported[NUM_PORTS];
 /*
- * Counts the number of cycles since the input changed state.
+ * The bits which are debounced but still waiting for the NV delay to expire.
+ */
+static BYTE pending[NUM_PORTS];
+/*
+ * Map from port/bit back to the IO number.
+ */
+static BYTE portBitIo[NUM_PORTS][8];
+/*
+ * Counts the number of scans since the debounced input changed state.
  */
 static BYTE delayCount[NUM_IO];
+/*
+ * The rate limit token bucket of each input, and the scans until the next token.
+ */
+static BYTE tokens[NUM_IO];
+static WORD refillCount;
+/*
+ * The bits whose change is being held back by the rate limit, the IOs 
+ * which have sent the INPUT_CHATTER ON event and the time of their last change.
+ */
+static BYTE held[NUM_PORTS];
+static WORD chatterMask;
+static DWORD chatterTime[NUM_IO];
+/*
+ * PORTB bits which use the interrupt fast path, the PORTB state when last
+ * checked by the ISR, and the bits which have changed since the last fast scan.
+ */
+static BYTE fastMask;
+static BYTE fastSnapshot;
+static volatile BYTE fastEdges;
+/*
+ * The time of the last edge on each of the fast inputs RB0, RB1, RB4, RB5, 
+ * and the bits locked out of the fast path since the edge they reported.
+ */
+static volatile DWORD fastEdgeTime[4];
+static DWORD fastLockTime[4];
+static BYTE fastLocked;
 
 // forward declarations
 BOOL readInput(unsigned char io);
+void buildInputMasks(void);
+static void readPorts(BYTE * sample);
+static void processChanges(unsigned char p, BOOL tick);
+static void fastInputScan(void);
+static void unlockFastInputs(void);
+static void reportInput(unsigned char io, BOOL state);
+static BOOL takeToken(unsigned char io);
+static void refillTokens(void);
+
+#define REFILL_SCANS    10  // input scans per inputRefill unit of 10ms
+#define INPUT_BURST     (nodeVarTable.moduleNVs.inputBurst ? nodeVarTable.moduleNVs.inputBurst : 1)
 
 static unsigned char io;
 
@@ -38,69 +141,352 @@ static unsigned char io;
  * change events on power up.
  */
 void initInputScan(void) {
+    unsigned char p;
+    
+    buildInputMasks();
+    readPorts(debounced);
+    for (p=0; p<NUM_PORTS; p++) {
+        reported[p] = debounced[p];
+        pending[p] = 0;
+        held[p] = 0;
+        count0[p] = count1[p] = 0xFF;
+    }
+    for (io=0; io<NUM_IO; io++) {
+        delayCount[io] = 0;
+        tokens[io] = INPUT_BURST;
+    }
+    refillCount = 0;
+    chatterMask = 0;
+    fastSnapshot = PORTB;
+    fastEdges = 0;
+    fastLocked = 0;
+}
+
+/**
+ * Build the per port input and inversion masks from the pin map and NVs and
+ * set the port directions to match. Must be called whenever the type or the 
+ * inversion of an IO changes.
+ */
+void buildInputMasks(void) {
+    unsigned char p;
+    unsigned char b;
+    BYTE mask;
+    
+    for (p=0; p<NUM_PORTS; p++) {
+        inputMask[p] = 0;
+        invertMask[p] = 0;
+        for (b=0; b<8; b++) {
+            portBitIo[p][b] = NO_IO;
+        }
+    }
     for (io=0; io<NUM_IO; io++) {
-        inputState[io] = readInput(io);
+        p = ioPortIndex[io];
+        mask = pinPorts[io].setMask;
+        portBitIo[p][ioBitNo[io]] = io;
+        if (ioConfig[io].nv.type == TYPE_INPUT) {
+            inputMask[p] |= mask;
+            if (ioConfig[io].nv.nv_io.nv_input.input_inverted) {
+                invertMask[p] |= mask;
+            }
+        }
+    }
+    // don't report a change for inputs which have just been removed
+    for (p=0; p<NUM_PORTS; p++) {
+        debounced[p] &= inputMask[p];
+        reported[p] &= inputMask[p];
+        pending[p] &= inputMask[p];
+    }
+    // the IO pins which aren't inputs are outputs, leave the other pins alone
+    TRISA = (TRISA & ~IO_PINS_A) | inputMask[PORT_A];
+    TRISB = (TRISB & ~IO_PINS_B) | inputMask[PORT_B];
+    TRISC = (TRISC & ~IO_PINS_C) | inputMask[PORT_C];
+    
+    // set up the fast path interrupts
+    if (nodeVarTable.moduleNVs.flags & NV_FLAG_FAST_INPUTS) {
+        fastMask = inputMask[PORT_B] & FAST_INPUT_BITS;
+    } else {
+        fastMask = 0;
+    }
+    INTCON2bits.RBIP = 0;       // port change is low priority
+    INTCON3bits.INT1IP = 0;     // INT1 is low priority. INT0 is always high priority
+    INTCON2bits.INTEDG0 = (PORTB & 0x01) ? 0 : 1;
+    INTCON2bits.INTEDG1 = (PORTB & 0x02) ? 0 : 1;
+    IOCB = fastMask & 0xF0;     // only RB4..RB7 support interrupt on change
+    INTCONbits.INT0IF = 0;
+    INTCON3bits.INT1IF = 0;
+    INTCONbits.INT0IE = (fastMask & 0x01) ? 1 : 0;
+    INTCON3bits.INT1IE = (fastMask & 0x02) ? 1 : 0;
+    // INT0 uses the port change interrupt to get into the low priority ISR
+    INTCONbits.RBIE = fastMask ? 1 : 0;
+}
+
+/**
+ * Called every pass of the main loop. Performs the fast path for any inputs 
+ * which have interrupted.
+ */
+void pollInputs(void) {
+    if (fastEdges) {
+        fastInputScan();
     }
 }
 
 /**
- * Called regularly to check for changes on the inputs.
+ * Called every INPUT_SCAN_PERIOD to check for changes on the inputs.
  * Generate Produced events upon input change.
  *   
  */
 void inputScan(void) {
-    for (io=0; io< NUM_IO; io++) {
-        if (nodeVarTable.moduleNVs.io[io].type == TYPE_INPUT) {
-            BYTE input = readInput(io);
-            if (input != inputState[io]) {
-                BOOL change = FALSE;
-                // check if we have reached the debounce count
-                if (inputState[io] && (delayCount[io] == nodeVarTable.moduleNVs.io[io].nv_io.nv_input.input_on_delay)) {
-                    change = TRUE;
-                }
-                if (!inputState[io] && (delayCount[io] == nodeVarTable.moduleNVs.io[io].nv_io.nv_input.input_off_delay)) {
-                    change = TRUE;
-                }
-                if (change) {
-                    delayCount[io] = 0;
-                    inputState[io] = input;
-                    // check if input is inverted
-                    if (nodeVarTable.moduleNVs.io[io].nv_io.nv_input.input_inverted) {
-                        input = !input;
-                    }
-                    // send the changed Produced event
-                    if (input) {
-                        cbusSendEvent( 0, -1, ACTION_IO_PRODUCER_INPUT_OFF2ON(io), TRUE);
-                    } else {
-                        // check if OFF events are enabled
-                        if (nodeVarTable.moduleNVs.io[io].nv_io.nv_input.input_enable_off) {
-                            cbusSendEvent( 0, -1, ACTION_IO_PRODUCER_INPUT_ON2OFF(io), FALSE);
-                        }
+    BYTE sample[NUM_PORTS];
+    BYTE delta;
+    unsigned char p;
+    
+    readPorts(sample);
+    for (p=0; p<NUM_PORTS; p++) {
+        // vertical counter debounce of all the bits of the port
+        delta = sample[p] ^ debounced[p];
+        count0[p] = ~(count0[p] & delta);
+        count1[p] = count0[p] ^ (count1[p] & delta);
+        delta &= count0[p] & count1[p];
+        debounced[p] ^= delta;
+        
+        processChanges(p, TRUE);
+    }
+    refillTokens();
+    if (fastLocked) {
+        unlockFastInputs();
+    }
+}
+
+/**
+ * Put the fast inputs whose lockout has expired back on the fast path.
+ */
+static void unlockFastInputs(void) {
+    unsigned char b;
+    DWORD now = tickGet();
+    
+    for (b=0; b<6; b++) {
+        if ((fastLocked & (1 << b)) && 
+                ((now - fastLockTime[FAST_EDGE_INDEX(b)]) >= FAST_LOCKOUT)) {
+            fastLocked &= ~(1 << b);
+        }
+    }
+}
+
+/**
+ * Handle the inputs on a port whose debounced state differs from the reported 
+ * state. Each is reported once its NV delay has expired.
+ * @param p the port
+ * @param tick TRUE if called from the periodic scan so the delay should be counted
+ */
+static void processChanges(unsigned char p, BOOL tick) {
+    BYTE changed;
+    BYTE mask;
+    BYTE delay;
+    unsigned char b;
+    
+    changed = debounced[p] ^ reported[p];
+    // inputs which bounced back before their delay expired
+    mask = pending[p] & ~changed;
+    pending[p] = changed;
+    if ((changed | mask) == 0) return;
+    for (b=0; b<8; b++) {
+        BYTE bit = 1 << b;
+        if (mask & bit) {
+            delayCount[portBitIo[p][b]] = 0;
+            held[p] &= ~bit;
+        }
+        if (changed & bit) {
+            io = portBitIo[p][b];
+            // check if we have reached the NV delay
+            if (debounced[p] & bit) {
+                delay = ioConfig[io].nv.nv_io.nv_input.input_on_delay;
+            } else {
+                delay = ioConfig[io].nv.nv_io.nv_input.input_off_delay;
+            }
+            if (delayCount[io] >= delay) {
+                if ( ! takeToken(io)) {
+                    // over the rate limit, keep the change until a token is earned
+                    if ( ! (held[p] & bit)) {
+                        held[p] |= bit;
+                        PERF_INC(perf.inputChatter);
                     }
+                    continue;
                 }
-                delayCount[io]++;
-            } else {
+                held[p] &= ~bit;
                 delayCount[io] = 0;
+                reported[p] ^= bit;
+                pending[p] &= ~bit;
+                reportInput(io, (debounced[p] & bit) ? TRUE : FALSE);
+            } else if (tick) {
+                delayCount[io]++;
             }
         }
     }
 }
 
+/**
+ * Take a rate limit token for an input change. Sends the INPUT_CHATTER ON
+ * event when an input first runs out of tokens.
+ * @param io the IO number
+ * @return TRUE if the change may be sent
+ */
+static BOOL takeToken(unsigned char io) {
+    if (nodeVarTable.moduleNVs.inputRefill == 0) return TRUE;
+    if (chatterMask & IO_BIT(io)) {
+        chatterTime[io] = tickGet();
+    }
+    if (tokens[io]) {
+        tokens[io]--;
+        return TRUE;
+    }
+    if ( ! (chatterMask & IO_BIT(io))) {
+        chatterMask |= IO_BIT(io);
+        chatterTime[io] = tickGet();
+        sendProducedEvent(ACTION_IO_PRODUCER_INPUT_CHATTER(io), TRUE);
+    }
+    return FALSE;
+}
+
+/**
+ * Give every input another token each inputRefill*10ms, up to the burst.
+ * Sends the INPUT_CHATTER OFF event for an input whose bucket is full again
+ * and which has made no change for CHATTER_HOLD.
+ */
+static void refillTokens(void) {
+    BYTE burst;
+    DWORD now;
+    
+    if (nodeVarTable.moduleNVs.inputRefill == 0) return;
+    if (++refillCount < (WORD)nodeVarTable.moduleNVs.inputRefill * REFILL_SCANS) return;
+    refillCount = 0;
+    burst = INPUT_BURST;
+    now = tickGet();
+    for (io=0; io<NUM_IO; io++) {
+        if (tokens[io] < burst) tokens[io]++;
+        if ((tokens[io] >= burst) && (chatterMask & IO_BIT(io)) &&
+                ((now - chatterTime[io]) >= CHATTER_HOLD)) {
+            chatterMask &= ~IO_BIT(io);
+            sendProducedEvent(ACTION_IO_PRODUCER_INPUT_CHATTER(io), FALSE);
+        }
+    }
+}
+
+/**
+ * The fast path for the RB inputs which have interrupted. These are taken as
+ * debounced immediately and reported without waiting for the next scan if
+ * they have no NV delay. Edges on inputs locked out after an earlier edge are
+ * left to the vertical counter.
+ */
+static void fastInputScan(void) {
+    BYTE edges;
+    BYTE state;
+    unsigned char b;
+    
+    INTCONbits.GIEL = 0;
+    edges = fastEdges & ~fastLocked;
+    fastEdges = 0;
+    for (b=0; b<6; b++) {
+        if (edges & (1 << b)) {
+            fastLockTime[FAST_EDGE_INDEX(b)] = fastEdgeTime[FAST_EDGE_INDEX(b)];
+        }
+    }
+    INTCONbits.GIEL = 1;
+    if (edges == 0) return;
+    fastLocked |= edges;
+    
+    state = (PORTB ^ invertMask[PORT_B]) & edges;
+    debounced[PORT_B] = (debounced[PORT_B] & ~edges) | state;
+    // reset the vertical counters
+    count0[PORT_B] |= edges;
+    count1[PORT_B] |= edges;
+    processChanges(PORT_B, FALSE);
+}
+
+/**
+ * Called from the low priority ISR. Handles the INT1 and port change 
+ * interrupts for the fast path inputs and timestamps the edges.
+ */
+void inputChangeInterruptHandler(void) {
+    BYTE now;
+    BYTE changed;
+    DWORD when;
+    unsigned char b;
+    
+    if (!((INTCONbits.RBIE && INTCONbits.RBIF) || (INTCON3bits.INT1IE && INTCON3bits.INT1IF))) return;
+    now = PORTB;                // reading PORTB ends the mismatch condition
+    INTCONbits.RBIF = 0;
+    INTCON3bits.INT1IF = 0;
+    // INT0 and INT1 are edge triggered so look for the opposite edge next
+    INTCON2bits.INTEDG0 = (now & 0x01) ? 0 : 1;
+    INTCON2bits.INTEDG1 = (now & 0x02) ? 0 : 1;
+    
+    changed = (now ^ fastSnapshot) & fastMask;
+    fastSnapshot = now;
+    if (changed) {
+        when = tickGet();
+        for (b=0; b<6; b++) {
+            if (changed & FAST_INPUT_BITS & (1 << b)) {
+                fastEdgeTime[FAST_EDGE_INDEX(b)] = when;
+            }
+        }
+        fastEdges |= changed;
+    }
+}
+
+/**
+ * Called from the high priority ISR as INT0 can't be made low priority. Pass 
+ * the edge on to the low priority ISR by setting the port change flag.
+ */
+void int0InterruptHandler(void) {
+    INTCONbits.INT0IF = 0;
+    INTCONbits.RBIF = 1;
+}
+
+/**
+ * Send the Produced event for an input change.
+ * @param io the IO number
+ * @param state the new input state, after inversion
+ */
+static void reportInput(unsigned char io, BOOL state) {
+    if (state) {
+        sendProducedEvent(ACTION_IO_PRODUCER_INPUT_OFF2ON(io), TRUE);
+    } else {
+        // check if OFF events are enabled
+        if (ioConfig[io].nv.nv_io.nv_input.input_enable_off) {
+            sendProducedEvent(ACTION_IO_PRODUCER_INPUT_ON2OFF(io), FALSE);
+        }
+    }
+}
+
+/**
+ * Take a snapshot of the ports. Each port is read exactly once. The non input
+ * bits are masked out and the inverted inputs are inverted.
+ * @param sample the array to be filled with the port snapshot
+ */
+static void readPorts(BYTE * sample) {
+    sample[PORT_A] = (PORTA ^ invertMask[PORT_A]) & inputMask[PORT_A];
+    sample[PORT_B] = (PORTB ^ invertMask[PORT_B]) & inputMask[PORT_B];
+    sample[PORT_C] = (PORTC ^ invertMask[PORT_C]) & inputMask[PORT_C];
+}
+
+/**
+ * Get the currently reported state of an input, after inversion. This is the
+ * state of the last Produced event rather than the instantaneous pin level.
+ * @param io the IO number
+ * @return TRUE if the input is reported as ON
+ */
+BOOL getInputState(unsigned char io) {
+    return (reported[ioPortIndex[io]] & pinPorts[io].setMask) ? TRUE : FALSE;
+}
+
 /**
  * Read the input state from the IO pins.
  * @param io the IO number
  * @return Non zero is the input is high or FALSE if the input is low
  */
 BOOL readInput(unsigned char io) {
-    if (nodeVarTable.moduleNVs.io[io].type == TYPE_INPUT) {
-            switch(configs[io].port) {
-            case 'a':
-                return TRISA & (1<<configs[io].no);
-            case 'b':
-                return TRISB & (1<<configs[io].no);
-            case 'c':
-                return TRISA & (1<<configs[io].no);
-            }
-        }
+    if (ioConfig[io].nv.type == TYPE_INPUT) {
+        return *pinPorts[io].port & pinPorts[io].setMask;
+    }
     return FALSE;
 }
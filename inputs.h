@@ -12,10 +12,35 @@
 extern "C" {
 #endif
 
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+#define INPUT_SCAN_PERIOD   ONE_MILI_SECOND
+
     /**
      * Scans the input IO.
      */
     extern void initInputScan(void);
+    /**
+     * Run by the scheduler every INPUT_SCAN_PERIOD.
+     */
+    extern void inputScan(void);
+    /**
+     * Called every main loop pass for the fast path inputs.
+     */
+    extern void pollInputs(void);
+    /**
+     * The fast path interrupt handlers.
+     */
+    extern void inputChangeInterruptHandler(void);
+    extern void int0InterruptHandler(void);
+    /**
+     * Rebuild the per port input and inversion masks after an NV change.
+     */
+    extern void buildInputMasks(void);
+    /**
+     * The reported state of an input, after inversion and the NV delays.
+     */
+    extern BOOL getInputState(unsigned char io);
 
 
 #ifdef	__cplusplus
@@ -0,0 +1,53 @@
+/* 
+ * File:   ioCache.c
+ * Author: Ian
+ * 
+ * A RAM copy of the IO NVs for the handlers which run on every loop so they 
+ * don't have to read program Flash, together with bit masks of the IOs of 
+ * each type and of those which currently need work. The handlers only visit 
+ * the IOs in the relevant mask so an idle module costs very little.
+ * 
+ * The type masks and config are rebuilt from the NVs whenever they change. 
+ * The live masks (servoOnMask, movingMask, pulsingMask) are maintained by
+ * the servo and output handlers.
+ *
+ * Created on 14 October 2026
+ */
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "ioCache.h"
+
+IoConfig ioConfig[NUM_IO];
+WORD typeMask[NUM_TYPES];
+WORD servoMask;
+WORD servoOnMask;
+WORD movingMask;
+WORD pulsingMask;
+
+const WORD ioBits[NUM_IO] = {
+    0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+    0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, 0x8000
+};
+
+void buildIoCache(void) {
+    unsigned char io;
+    unsigned char t;
+    
+    for (t=0; t<NUM_TYPES; t++) {
+        typeMask[t] = 0;
+    }
+    for (io=0; io<NUM_IO; io++) {
+        ioConfig[io].nv = nodeVarTable.moduleNVs.io[io];
+        t = ioConfig[io].nv.type;
+        if (t < NUM_TYPES) typeMask[t] |= IO_BIT(io);
+        ioConfig[io].midway = (ioConfig[io].nv.nv_io.nv_servo.servo_end_pos + 
+                    ioConfig[io].nv.nv_io.nv_servo.servo_start_pos)/2;
+    }
+    servoMask = typeMask[TYPE_SERVO] | typeMask[TYPE_BOUNCE] | typeMask[TYPE_MULTI];
+    // an IO which is no longer a servo or output can't be active
+    servoOnMask &= servoMask;
+    movingMask &= servoMask;
+    pulsingMask &= typeMask[TYPE_OUTPUT];
+}
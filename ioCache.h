@@ -0,0 +1,52 @@
+/* 
+ * File:   ioCache.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef IOCACHE_H
+#define	IOCACHE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "mioNv.h"
+
+#define NUM_TYPES               (TYPE_MULTI+1)
+
+    /*
+     * RAM copy of an IO's configuration.
+     */
+    typedef struct {
+        NvIo nv;            // copy of the IO's NVs
+        BYTE midway;        // servo mid point for the frog switching events
+    } IoConfig;
+    
+    extern IoConfig ioConfig[NUM_IO];
+    
+    /*
+     * Sets of IO, bit n for IO n.
+     */
+    extern WORD typeMask[NUM_TYPES];    // IOs of each type
+    extern WORD servoMask;              // IOs of any servo type
+    extern WORD servoOnMask;            // servos which are generating pulses
+    extern WORD movingMask;             // servos which are MOVING
+    extern WORD pulsingMask;            // digital outputs with a pulse or flash pending
+    
+    extern const WORD ioBits[NUM_IO];
+#define IO_BIT(io)              (ioBits[io])
+
+    /**
+     * Rebuild the cache from the NVs. Called at initialisation and after NVs change.
+     */
+    extern void buildIoCache(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* IOCACHE_H */
+
@@ -6,10 +6,10 @@
  * 
  * Timer usage:
  * TMR0 used in ticktime for symbol times. Used to trigger next set of servo pulses
- * TMR1 Servo outputs 0, 4, 8, 12
- * TMR2 Servo outputs 1, 5, 9, 13
- * TMR3 Servo outputs 2, 6, 10, 14
- * TMR4 Servo outputs 3, 7, 11, 15
+ * TMR1 free running time base for the CCP compares
+ * ECCP1 1ms wake up from IDLE
+ * CCP2..CCP5 Servo pulse channels 0..3, the active servos are packed into the channels
+ * TMR2, TMR3, TMR4 unused
  *
  * Created on 10 April 2017, 10:26
  */
@@ -22,11 +22,11 @@
  * DONE  debounce inputs
  * DONE  invert inputs
  * DONE  invert outputs
- * digital output pulse output.c
- * bounce profiles  
+ * DONE  digital output pulse output.c
+ * DONE  bounce profiles
  * DONE  multi-position outputs
- * sequence servos servo.c
- * remember output state in EEPROM outputs.c & servo.c
+ * DONE  sequence servos servo.c
+ * DONE  remember output state in EEPROM outputs.c & servo.c
  * Flicker LED on CAN activity can18.c
  * Work out what to do if all CANIDs are taken can18.c
  * Check handling of NERD is correct and produces correct ENRSP events.c
@@ -50,6 +50,16 @@
 #include "config.h"
 #include "../CBUSlib/StatusLeds.h"
 #include "inputs.h"
+#include "txQueue.h"
+#include "eventIndex.h"
+#include "scheduler.h"
+#include "actionQueue.h"
+#include "stateStore.h"
+#include "ioCache.h"
+#include "idle.h"
+#include "perf.h"
+#include "canFilters.h"
+#include "stateReport.h"
 #include "mioEEPROM.h"
 #include "../CBUSlib/events.h"
 #include "mioNv.h"
@@ -60,39 +70,24 @@ extern BYTE BlinkLED();
 extern void startServos();
 extern void initServos();
 extern void pollServos();
-extern inline void timer1DoneInterruptHandler();
-extern inline void timer2DoneInterruptHandler();
-extern inline void timer3DoneInterruptHandler();
-extern inline void timer4DoneInterruptHandler();
+extern void waitServoPulsesDone(void);
+extern void resetServo(unsigned char io);
+extern void restoreOutputs(void);
+extern void setOutputPin(unsigned char io, BOOL state);
+extern void channel0DoneInterruptHandler();
+extern void channel1DoneInterruptHandler();
+extern void channel2DoneInterruptHandler();
+extern void channel3DoneInterruptHandler();
 
 unsigned char canid = 0;        // initialised from ee
 unsigned int nn = DEFAULT_NN;   // initialised from ee
 //int mode;                       // initialised from ee
 
-// PIN configs
-Config configs[NUM_IO] = {
-    {18, 'C', 7},   //0
-    {17, 'C', 6},   //1
-    {16, 'C', 5},   //2
-    {15, 'C', 4},   //3
-    {14, 'C', 3},   //4
-    {13, 'C', 2},   //5
-    {12, 'C', 1},   //6
-    {11, 'C', 0},   //7
-    {21, 'B', 0},   //8
-    {22, 'B', 1},   //9
-    {25, 'B', 4},   //10
-    {26, 'B', 5},   //11
-    {3,  'A', 1},   //12
-    {2,  'A', 0},   //13
-    {5,  'A', 3},   //14
-    {7,  'A', 5}    //15
-};
-
 // forward declarations
-BYTE inputScan(void);
 void __init(void);
 BOOL checkCBUS( void);
+BOOL receiveCBUS( void);
+void initOpcodeFilter(void);
 void ISRHigh(void);
 void initialise(void);
 void configIO(unsigned char io);
@@ -153,8 +148,6 @@ void LOW_INT_VECT(void)
 
 static TickValue   startTime;
 static BOOL        started = FALSE;
-static TickValue   lastServoPollTime;
-static TickValue   lastServoStartTime;
 static unsigned char io;
 
 // MAIN APPLICATION
@@ -168,6 +161,8 @@ void main(void) {
 #else
 int main(void) @0x800 {
 #endif
+    BOOL busy;
+    
     initialise();
     startTime.Val = tickGet();
  
@@ -178,23 +173,24 @@ int main(void) @0x800 {
             if (NV->sendSodDelay > 0) {
                 sendProducedEvent(ACTION_SOD, TRUE);
             }
+            // register the module's periodic work now that we are running
+            addTask(pollInputs, 0);                     // fast path inputs, every pass
+            addTask(inputScan, INPUT_SCAN_PERIOD);
+            servoStartTask = addTask(startServos, 5*ONE_MILI_SECOND);
+            servoPollTask = addTask(pollServos, 20*ONE_MILI_SECOND);
+            // the groups are timed from now so each group's servos start pulsing in their own frame
+            restoreOutputs();   // staggered by the startup NVs
         }
-        checkCBUS();    // Consume any CBUS message - display it if not display message mode
+        perfLoopStart();
+        busy = checkCBUS();    // Consume any CBUS message - display it if not display message mode
+        txQueueDrain(); // Send any queued Produced events
         FLiMSWCheck();  // Check FLiM switch for any mode changes
-        
+        runTasks();     // Periodic work including checking for any flashing status LEDs
+        pollLoopback(); // Act upon our own Produced events which we also consume
+        perfLoopEnd();
         if (started) {
-            inputScan();    // Strobe keyboard for button presses
-            if (tickTimeSince(lastServoStartTime) > 5*ONE_MILI_SECOND) {
-                startServos();  // call every 5ms
-                lastServoStartTime.Val = tickGet();
-            }
-            if (tickTimeSince(lastServoPollTime) > 20*ONE_MILI_SECOND) {
-                pollServos();
-                lastServoPollTime.Val = tickGet();
-            }
+            idleIfQuiet(busy);  // IDLE until the next interrupt if there is nothing to do
         }
-        // Check for any flashing status LEDs
-        checkFlashing();
      } // main loop
 } // main
  
@@ -217,6 +213,8 @@ void initialise(void) {
         // set the reset flag to indicate it has been initialised
         ee_write((WORD)EE_RESET, 0xCA);
     }
+    // convert the NVs left by an older firmware
+    upgradeNVs();
     canid = ee_read((WORD)EE_CAN_ID);
     nn = ee_read((WORD)EE_NODE_ID);
     
@@ -226,12 +224,28 @@ void initialise(void) {
     INTCON2bits.RBPU = 0;
     // RB bits 0,1,4,5 need pullups
     WPUB = 0x33; 
+    buildIoCache();
+    initTxQueue();
+    initOpcodeFilter();
+    // get CAN going as early as possible, the outputs are restored later from the main loop
+    mioFlimInit(); // This will call FLiMinit, which, in turn, calls eventsInit
+    rebuildEventIndex();
+    rebuildCanFilters();
+    initActionQueue();
+    initStateStore();   // reads the whole state journal in one pass
     for (io=0; io< NUM_IO; io++) {
         configIO(io);
     }
+    initScheduler();
+    addTask(checkFlashing, 0);  // status LEDs, every pass
+    addTask(pollActionQueue, 0);    // pulsed and flashing outputs, restores and sequences
+    addTask(pollStateStore, 0);     // output state persistence
+    addTask(pollNvTransaction, 0);  // commit idle NV changes
+    addTask(pollStateReport, 0);    // paced reply to a consumed SoD
     initInputScan();
     initServos();
-    mioFlimInit(); // This will call FLiMinit, which, in turn, calls eventsInit
+    initIdle();
+    resetPerf();
 
     // Enable interrupt priority
     RCONbits.IPEN = 1;
@@ -251,41 +265,170 @@ void defaultPersistentMemory(void) {
     ee_write((WORD)EE_CAN_ID, DEFAULT_CANID);
     ee_write_short((WORD)EE_NODE_ID, DEFAULT_NN); 
     ee_write((WORD)EE_FLIM_MODE, fsSLiM);
+    // the default NVs are in the current layout
+    ee_write((WORD)EE_NV_VERSION, NV_VERSION);
     
     // flash is initialised as a constant in mioNv
     // perform other actions based upon type
     unsigned char i;
+    beginNvTransaction();
     for (io=0; io<NUM_IO; io++) {
         //default type is INPUT
         setType(io, TYPE_INPUT);
     }
-    flushFlashImage();
+    commitNvTransaction();
 }
 
 /**
  * Set the Type of the IO.
+ * The NVs are only written to the Flash image, the caller must flush it and 
+ * rebuild the event index, which commitNvTransaction() does.
  * @param i the IO
  * @param type the new Type
  */
 void setType(unsigned char i, unsigned char type) {
-    writeFlashImage((BYTE*)(AT_NV+NV_IO_TYPE(i)), type);
+    // stop any servo move, its sequential slot is needed by the others
+    resetServo(i);
+    writeNV(NV_IO_TYPE(i), type);
     // set to default NVs
     defaultNVs(i, type);
     // set up the default events
     defaultEvents(i, type);
 }
 
+/*
+ * The opcodes which this module or the library act upon, one bit per opcode.
+ * Anything else is dropped without being passed to parseCBUSMsg.
+ */
+static BYTE opcodeFilter[32];
+static const BYTE handledOpcodes[] = {
+    OPC_QNN, OPC_RQNP, OPC_RQMN, OPC_SNN, OPC_NNLRN, OPC_NNULN, OPC_NNCLR, 
+    OPC_NNEVN, OPC_NERD, OPC_RQEVN, OPC_RQNPN, OPC_NVRD, OPC_NENRD, OPC_NVSET,
+    OPC_EVULN, OPC_REVAL, OPC_REQEV, OPC_EVLRN, OPC_EVLRNI, OPC_BOOT, OPC_ENUM,
+    OPC_CANID, OPC_AREQ, OPC_ASRQ, OPC_RDGN
+};
+#define OPCODE_HANDLED(opc)     (opcodeFilter[(opc) >> 3] & (1 << ((opc) & 7)))
+
+/**
+ * Build the opcode filter. All the accessory event opcodes are included as
+ * they go to the library in learn mode.
+ */
+void initOpcodeFilter(void) {
+    unsigned int opc;
+    unsigned char i;
+    
+    for (i=0; i<sizeof(opcodeFilter); i++) {
+        opcodeFilter[i] = 0;
+    }
+    for (opc=0; opc<256; opc++) {
+        if (IS_EVENT_OPC(opc)) {
+            opcodeFilter[opc >> 3] |= (1 << (opc & 7));
+        }
+    }
+    for (i=0; i<sizeof(handledOpcodes); i++) {
+        opcodeFilter[handledOpcodes[i] >> 3] |= (1 << (handledOpcodes[i] & 7));
+    }
+}
+
+#define RX_TIME_BUDGET      2000    // TMR1 counts, 500us
+
+/**
+ * Handle the received CBUS messages. Up to the rxBudget NV frames are 
+ * handled in one pass of the main loop, stopping early after RX_TIME_BUDGET
+ * so the rest of the loop, and the servo timing, still runs during a burst.
+ * @return true if a message has been received.
+ */
+BOOL checkCBUS( void ) {
+    BYTE budget;
+    BYTE frames;
+    WORD start;
+    
+    budget = NV->rxBudget;
+    if (budget == 0) budget = 1;
+    start = TMR1;
+    for (frames=0; frames<budget; frames++) {
+        if ( ! receiveCBUS()) break;
+        if ((WORD)(TMR1 - start) >= RX_TIME_BUDGET) {
+            frames++;
+            break;
+        }
+    }
+    return (frames > 0);
+}
+
 /**
  * Check to see if a message has been received on the CBUS and process 
  * it if one has been received.
+ * Accessory events are handled here using the RAM event index. Opcodes not in
+ * the filter are dropped. Everything else, and all events whilst in learn
+ * mode, goes to the library.
  * @return true if a message has been received.
  */
-BOOL checkCBUS( void ) {
-    char    msg[20];
+BOOL receiveCBUS( void ) {
+    BYTE    msg[20];
 
-    if (cbusMsgReceived( 0, (BYTE *)msg )) {
+    if (cbusMsgReceived( 0, msg )) {
         LED2G = BlinkLED( 1 );           // Blink LED on whilst processing messages - to give indication how busy module is
+        PERF_INC(perf.canRx);
+        if (IS_EVENT_OPC(msg[d0]) && (flimState != fsFLiMLearn)) {
+            dispatchEvent(msg);
+            return TRUE;
+        }
+        if ( ! OPCODE_HANDLED(msg[d0])) {
+            // nothing for us, e.g. a reply from another node
+            return TRUE;
+        }
+        switch (msg[d0]) {
+            case OPC_NVSET:
+                if ((flimState == fsFLiM) && thisNN(msg)) {
+                    // batch NV changes into a transaction, committed when idle or on NNULN
+                    if (setNvPending(msg[d3], msg[d4])) {
+                        cbusSendOpcMyNN(0, OPC_WRACK, msg);
+                    } else {
+                        doError(CMDERR_INV_NV_IDX);
+                    }
+                    return TRUE;
+                }
+                break;
+            case OPC_RDGN:
+                if (thisNN(msg)) {
+                    perfRequest(msg);
+                    return TRUE;
+                }
+                break;
+            case OPC_NVRD:
+            case OPC_NNLRN:
+            case OPC_NNULN:
+                // make sure the library sees the committed NVs, and end a learn session
+                commitNvTransaction();
+                break;
+            case OPC_EVLRN:
+            case OPC_EVLRNI:
+            case OPC_EVULN:
+            case OPC_NNCLR:
+            case OPC_SNN:
+            case OPC_CANID:
+            case OPC_ENUM:
+            case OPC_BOOT:
+                // the library may write Flash or EEPROM for these, keep it out of a servo pulse
+                waitServoPulsesDone();
+                break;
+        }
         parseCBUSMsg(msg);               // Process the incoming message
+        switch (msg[d0]) {
+            case OPC_EVLRN:
+            case OPC_EVLRNI:
+            case OPC_EVULN:
+            case OPC_NNCLR:
+                // taught events have changed, acted upon at the end of the learn session
+                setEventsPending();
+                break;
+            case OPC_NNLRN:
+            case OPC_NNULN:
+                // the CAN filters are open in learn mode
+                rebuildCanFilters();
+                break;
+        }
         return TRUE;
     }
     return FALSE;
@@ -294,49 +437,36 @@ BOOL checkCBUS( void ) {
 
 /**
  * Set up an IO based upon the specified type.
- * Set the port to input or output then call setOutput for the currently remembered state.
+ * A digital output is driven to its OFF level before the port direction is set 
+ * by buildInputMasks(). The remembered output state is restored later by 
+ * restoreOutputs().
  * @param i the IO
  */
 void configIO(unsigned char i) {
     if (i >= NUM_IO) return;
-    // Now actually set it
-    switch (configs[i].port) {
-        case 'A':
-            if (NV->io[i].type == TYPE_INPUT) {
-                TRISA |= (1 << configs[i].no);  // input
-            } else {
-                TRISA &= ~(1 << configs[i].no); // output
-                // If this is an output (OUTPUT, SERVO, BOUNCE) set the value to valued saved in EE
-                setOutput(i, ee_read((WORD)EE_OP_STATE+i), NV->io[i].type);
-            }
-            
-            break;
-        case 'B':
-            if (NV->io[i].type == TYPE_INPUT) {
-                TRISB |= (1 << configs[i].no);  // input
-            } else {
-                TRISB &= ~(1 << configs[i].no); // output
-                // If this is an output (OUTPUT, SERVO, BOUNCE) set the value to valued saved in EE
-                setOutput(i, ee_read((WORD)EE_OP_STATE+i), NV->io[i].type);
-            }
-            break;
-        case 'C':
-            if (NV->io[i].type == TYPE_INPUT) {
-                TRISC |= (1 << configs[i].no);  // input
-            } else {
-                TRISC &= ~(1 << configs[i].no); // output
-                // If this is an output (OUTPUT, SERVO, BOUNCE) set the value to valued saved in EE
-                setOutput(i, ee_read((WORD)EE_OP_STATE+i), NV->io[i].type);
-            }
-            break;          
+    if (NV->io[i].type == TYPE_OUTPUT) {
+        // hold the output OFF until its state is restored
+        setOutputPin(i, NV->io[i].nv_io.nv_output.outout_inverted);
     }
 }
 
 
+/**
+ * Send a Produced event. The event is queued and sent from the main loop. 
+ * Input events are sent ahead of output and servo events. If this module
+ * also consumes the event it is acted upon later in the same main loop pass.
+ * @param action the produced action
+ * @param on TRUE for an ON event
+ */
 void sendProducedEvent(unsigned char action, BOOL on) {
     const Event * ev = getProducedEvent(action);
     if (ev != NULL) {
-        cbusSendEvent( 0, ev->NN, ev->EN, on );
+        if ((action >= ACTION_PRODUCER_BASE) && (typeMask[TYPE_INPUT] & IO_BIT(PRODUCER_IO(action)))) {
+            txQueueEvent(TX_PRIORITY_HIGH, ev->NN, ev->EN, on);
+        } else {
+            txQueueEvent(TX_PRIORITY_LOW, ev->NN, ev->EN, on);
+        }
+        loopbackEvent(ev->NN, ev->EN, on);
     }
 }
 
@@ -361,29 +491,37 @@ void __init(void)
 #else 
     void interrupt low_priority low_isr(void) {
 #endif
+    idleWake = TRUE;
+    if (PIE3bits.CCP1IE && PIR3bits.CCP1IF) {
+        idleTickInterruptHandler();
+    }
     tickISR();
     canInterruptHandler();
+    inputChangeInterruptHandler();
 }
 
 
 void interrupt high_priority high_isr (void)
 {
- /* service the servo pulse width timers */
-    if (PIR1bits.TMR1IF) {
-        timer1DoneInterruptHandler();
-        PIR1bits.TMR1IF = 0;
+    WORD start = TMR1;
+    
+    /* INT0 fast path input edge, passed on to the low priority ISR */
+    if (INTCONbits.INT0IE && INTCONbits.INT0IF) {
+        int0InterruptHandler();
+    }
+ /* service the servo pulse width compares */
+    if (PIE3bits.CCP2IE && PIR3bits.CCP2IF) {
+        channel0DoneInterruptHandler();
     }
-    if (PIR1bits.TMR2IF) {
-        timer2DoneInterruptHandler();
-        PIR1bits.TMR2IF = 0;
+    if (PIE4bits.CCP3IE && PIR4bits.CCP3IF) {
+        channel1DoneInterruptHandler();
     }
-    if (PIR2bits.TMR3IF) {
-        timer3DoneInterruptHandler();
-        PIR2bits.TMR3IF = 0;
+    if (PIE4bits.CCP4IE && PIR4bits.CCP4IF) {
+        channel2DoneInterruptHandler();
     }
-    if (PIR4bits.TMR4IF) {
-        timer4DoneInterruptHandler();
-        PIR4bits.TMR4IF = 0;
+    if (PIE4bits.CCP5IE && PIR4bits.CCP5IF) {
+        channel3DoneInterruptHandler();
     }
+    perfIsr(start);
 }
 
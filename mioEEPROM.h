@@ -20,7 +20,21 @@ extern "C" {
     /**
      * Record the current output state for all the IO.
      */
-#define EE_OP_STATE         EE_TOP-6    // Space to store current state of up to 16 outputs
+#define EE_OP_STATE         EE_TOP-6    // Space to store current state of up to 16 outputs, no longer used
+    
+    /**
+     * The output state journal. A ring of records each holding a sequence 
+     * number, the last action for each of the 16 IO and a checksum. See stateStore.c
+     */
+#define EE_JOURNAL_RECORDS      32
+#define EE_JOURNAL_RECORD_SIZE  (1+16+1)
+#define EE_JOURNAL              (EE_OP_STATE - 16 - EE_JOURNAL_RECORDS*EE_JOURNAL_RECORD_SIZE)
+
+    /**
+     * The NV layout version, see NV_VERSION. 0xFF until written by a firmware
+     * which has it.
+     */
+#define EE_NV_VERSION           (EE_JOURNAL - 1)
     
 
 #ifdef	__cplusplus
@@ -13,9 +13,16 @@
 #include "mioEvents.h"
 #include "mioEEPROM.h"
 #include "mioNv.h"
+#include "ioCache.h"
+#include "stateReport.h"
+#include "actionQueue.h"
 #include "../../CBUSlib/events.h"
+#include "../../CBUSlib/TickTime.h"
+#include "../../CBUSlib/FLiM.h"
 #include <stddef.h>
 
+#define SEQUENCE_DELAY_UNIT     HUNDRED_MILI_SECOND
+
 extern void setOutput(unsigned char io, unsigned char state, unsigned char type);
 
 /**
@@ -84,10 +91,71 @@ void clearEvents(unsigned char i) {
  * @param msg the full CBUS message so that OPC  and DATA can be retrieved.
  */
 void processEvent(BYTE action, BYTE * msg) {
-    if (action < NUM_PRODUCER_ACTIONS) return;
-    action -= NUM_PRODUCER_ACTIONS;
-    unsigned char io = CONSUMER_IO(action);
-    action = CONSUMER_ACTION(action);
-    unsigned char type = NV->io[io].type;
-    setOutput(io, action, type);
-}
\ No newline at end of file
+    unsigned char io;
+    if (action < ACTION_CONSUMER_BASE) return;
+    if (action == ACTION_CONSUMER_SOD) {
+        startStateReport();
+        return;
+    }
+    if (action >= ACTION_CONSUMER_BASE + NUM_CONSUMER_ACTIONS) return;
+    io = CONSUMER_IO(action);
+    setOutput(io, CONSUMER_ACTION(action), ioConfig[io].nv.type);
+}
+
+/**
+ * Perform the actions in the EVs of an event starting at EV first. A delay 
+ * action stops the list and the rest of it is continued from the deferred 
+ * action queue when the delay is over.
+ * @param tableIndex the index of the event in the event table
+ * @param first the first EV to perform
+ * @param msg the full CBUS message, NULL when continuing a sequence
+ */
+static void runEventActions(BYTE tableIndex, BYTE first, BYTE * msg) {
+    BYTE action;
+    for (e=first; e<EVperEVT; e++) {
+        action = getEv(tableIndex, e);
+        if ((action == NO_ACTION) || (action == 0xFF)) return;
+        if (IS_DELAY_ACTION(action)) {
+            if (e+1 < EVperEVT) {
+                // the rest of the sequence is lost if the queue is full
+                deferAction(tickGet() + DELAY_STEPS(action)*SEQUENCE_DELAY_UNIT, DEFERRED_SEQUENCE, tableIndex, e+1);
+            }
+            return;
+        }
+        processEvent(action, msg);
+    }
+}
+
+/**
+ * Process all the actions of a consumed event. The EVs of the event hold a list
+ * of actions which are performed in order. The list ends at the first unused
+ * EV, or after EVperEVT actions, so one event can set a whole route.
+ * 
+ * A delay action in the list makes it a timed sequence, e.g. move a servo, 
+ * wait 500ms then switch an output. Each running sequence is just one entry in
+ * the deferred action queue so many can run at once for no more cost per tick
+ * than a single one. Consuming the event again restarts its sequence.
+ * @param tableIndex the index of the event in the event table
+ * @param msg the full CBUS message so that OPC  and DATA can be retrieved.
+ */
+void processEventActions(BYTE tableIndex, BYTE * msg) {
+    cancelDeferred(tableIndex, DEFERRED_SEQUENCE);
+    runEventActions(tableIndex, 0, msg);
+}
+
+/**
+ * Continue a sequence after a delay. Called from the deferred action queue.
+ * @param tableIndex the index of the event in the event table
+ * @param ev the EV after the delay
+ */
+void continueSequence(BYTE tableIndex, BYTE ev) {
+    runEventActions(tableIndex, ev, NULL);
+}
+
+/**
+ * Stop all running sequences. Called when the taught events change as the
+ * table index of a sequence may now be a different event.
+ */
+void cancelSequences(void) {
+    cancelDeferred(ANY_IO, DEFERRED_SEQUENCE);
+}
@@ -22,6 +22,7 @@ extern "C" {
 
     // Global produced actions first
 #define ACTION_SOD                          0
+#define NO_ACTION                           ACTION_SOD  // an unused EV, never valid as a consumed action
     // produced actions per io
 #define ACTION_PRODUCER_BASE                1
 #define ACTION_IO_PRODUCER_1                0
@@ -38,14 +39,21 @@ extern "C" {
 #define ACTION_IO_CONSUMER_4                3
 #define CONSUMER_ACTIONS_PER_IO             4   
 #define NUM_CONSUMER_ACTIONS                (NUM_IO * CONSUMER_ACTIONS_PER_IO)
+
+    // Global consumed actions after the per io ones
+#define ACTION_CONSUMER_SOD                 (ACTION_CONSUMER_BASE + NUM_CONSUMER_ACTIONS)  // report the state of all the IOs
+#define ACTION_CONSUMER_DELAY_BASE          (ACTION_CONSUMER_SOD + 1)   // wait before doing the rest of the EVs
+#define NUM_DELAY_ACTIONS                   64
+#define NUM_GLOBAL_CONSUMER_ACTIONS         (1 + NUM_DELAY_ACTIONS)
   
-#define NUM_ACTIONS                         (ACTION_PRODUCER_BASE + NUM_CONSUMER_ACTIONS + NUM_PRODUCER_ACTIONS)
+#define NUM_ACTIONS                         (ACTION_PRODUCER_BASE + NUM_CONSUMER_ACTIONS + NUM_GLOBAL_CONSUMER_ACTIONS + NUM_PRODUCER_ACTIONS)
 
 #define ACTION_IO_PRODUCER_BASE(i)              (ACTION_PRODUCER_BASE + PRODUCER_ACTIONS_PER_IO*(i))
 #define ACTION_IO_CONSUMER_BASE(i)              (ACTION_CONSUMER_BASE + CONSUMER_ACTIONS_PER_IO*(i))
     
 #define ACTION_IO_PRODUCER_INPUT_ON2OFF(i)     (ACTION_IO_PRODUCER_BASE(i)+ACTION_IO_PRODUCER_1)
 #define ACTION_IO_PRODUCER_INPUT_OFF2ON(i)     (ACTION_IO_PRODUCER_BASE(i)+ACTION_IO_PRODUCER_2)
+#define ACTION_IO_PRODUCER_INPUT_CHATTER(i)    (ACTION_IO_PRODUCER_BASE(i)+ACTION_IO_PRODUCER_3)
 #define ACTION_IO_PRODUCER_OUTPUT_ON(i)        (ACTION_IO_PRODUCER_BASE(i)+ACTION_IO_PRODUCER_1)
 #define ACTION_IO_PRODUCER_OUTPUT_OFF(i)       (ACTION_IO_PRODUCER_BASE(i)+ACTION_IO_PRODUCER_2)
 #define ACTION_IO_CONSUMER_OUTPUT_ON(i)        (ACTION_IO_CONSUMER_BASE(i)+ACTION_IO_CONSUMER_1)
@@ -69,6 +77,15 @@ extern "C" {
 #define ACTION_IO_CONSUMER_MULTI_TO3(i)        (ACTION_IO_CONSUMER_BASE(i)+ACTION_IO_CONSUMER_3)
 #define ACTION_IO_CONSUMER_MULTI_TO4(i)        (ACTION_IO_CONSUMER_BASE(i)+ACTION_IO_CONSUMER_4)
     
+#define ACTION_CONSUMER_DELAY(n)               (ACTION_CONSUMER_DELAY_BASE + (n) - 1)  // wait n*100ms, n is 1 to NUM_DELAY_ACTIONS
+#define IS_DELAY_ACTION(a)                     (((a) >= ACTION_CONSUMER_DELAY_BASE) && ((a) < ACTION_CONSUMER_DELAY_BASE + NUM_DELAY_ACTIONS))
+#define DELAY_STEPS(a)                         ((a) - ACTION_CONSUMER_DELAY_BASE + 1)
+    
+#if ACTION_CONSUMER_DELAY_BASE + NUM_DELAY_ACTIONS > 0xFF
+#error "Too many actions, 0xFF marks an unused EV"
+#endif
+    
+#define PRODUCER_IO(a)                         (((a)-ACTION_PRODUCER_BASE)/PRODUCER_ACTIONS_PER_IO)
 #define CONSUMER_ACTION(a)                     (((a)-ACTION_CONSUMER_BASE)%CONSUMER_ACTIONS_PER_IO)
 #define CONSUMER_IO(a)                         (((a)-ACTION_CONSUMER_BASE)/CONSUMER_ACTIONS_PER_IO)
 
@@ -83,12 +100,15 @@ extern void clearEvents(unsigned char i);
 #define CHAIN_LENGTH    20
 
 #define EVT_NUM                 NUM_ACTIONS // Number of events
-#define EVperEVT                17          // Event variables per event - just the action
+#define EVperEVT                17          // Event variables per event - a list of actions
 #define NUM_CONSUMED_EVENTS     192         // number of events that can be taught
 #define AT_ACTION2EVENT         0x7E70      //(AT_NV - sizeof(Event)*NUM_PRODUCER_ACTIONS) Size=256 bytes
 #define AT_EVENT2ACTION         0x6E80      //(AT_ACTION2EVENT - sizeof(Event2Action)*HASH_LENGTH) Size=4096bytes
 
-extern void processEvent(BYTE eventIndex, BYTE* message);
+extern void processEvent(BYTE action, BYTE* message);
+extern void processEventActions(BYTE tableIndex, BYTE* message);
+extern void continueSequence(BYTE tableIndex, BYTE ev);
+extern void cancelSequences(void);
 
 #ifdef	__cplusplus
 }
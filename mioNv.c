@@ -12,19 +12,35 @@
 #include "xc.h"
 #include "mioNv.h"
 #include "mioEEPROM.h"
+#include "inputs.h"
+#include "eventIndex.h"
+#include "ioCache.h"
+#include "canFilters.h"
+#include "idle.h"
+#include "mioEvents.h"
 #include "../../CBUSlib/events.h"
+#include "../../CBUSlib/TickTime.h"
+#include "../../CBUSlib/FLiM.h"
 
 extern void setType(unsigned char i, unsigned char type);
+extern BOOL servoPulsesDone(void);
+extern void waitServoPulsesDone(void);
+extern void servoLimitChanged(void);
 
 const NodeVarTable nodeVarTable @AT_NV = {    //  Allow 128 bytes for NVs. Declared const so it gets put into Flash
     0,  // sod delay
     0,  // hb delay
     0,  // cutoff
-    0,  // startup1
-    0,  // startup2
+    4,  // startup group
+    2,  // startup gap
     0,  // sequential
-    5,  // servo speed
-    0,0,0,0,0,0,0,0,  // spare
+    40, // servo speed
+    0,  // flags
+    8,  // rx budget
+    10, // sod gap
+    10, // input refill
+    4,  // input burst
+    0,0,0,  // spare
     0,  // io[0].type
     0,0,0,0,0,  // io[0]
     0,  // io[1].type
@@ -62,6 +78,17 @@ const NodeVarTable nodeVarTable @AT_NV = {    //  Allow 128 bytes for NVs. Decla
  Module specific NV routines
  */
 
+/*
+ * NV transaction state. The shadow holds the NV values including uncommitted
+ * changes since the NVs in Flash aren't updated until the flush.
+ */
+static BOOL nvTransaction = FALSE;
+static BOOL nvTypeChanged;
+static BOOL nvEventsChanged;
+static BOOL nvIoChanged;
+static BYTE nvShadow[NV_NUM+1];
+static TickValue nvLastChange;
+
 
 /**
  * Validate value of NV based upon bounds and inter-dependencies.
@@ -69,17 +96,195 @@ const NodeVarTable nodeVarTable @AT_NV = {    //  Allow 128 bytes for NVs. Decla
  */
 BOOL validateNV(unsigned char index, unsigned char oldValue, unsigned char value) {
     // TODO more validations
+    if ((index == 0) || (index > NV_NUM)) return FALSE;
     if (IS_NV_TYPE(index)) {
         if (value > TYPE_MULTI) return FALSE;
     }
+    if (index >= NV_IO_START) {
+        // checks against the (possibly not yet committed) type of the IO
+        if ((getPendingNV(NV_IO_TYPE(IO_NV(index))) == TYPE_MULTI) && 
+                (index == NV_IO_MULTI_NUM_POS(IO_NV(index)))) {
+            if ((value < 2) || (value > 4)) return FALSE;
+        }
+    }
     return TRUE;
 } 
 
 void actUponNVchange(unsigned char index, unsigned char value) {
+    if (nvTransaction) {
+        // acted upon when the transaction is committed
+        return;
+    }
     if (IS_NV_TYPE(index)) {
         // TODO more settings to be done
         setType(IO_NV(index), value);
+        waitServoPulsesDone();
+        flushFlashImage();
+        cancelSequences();
+        rebuildEventIndex();
+        rebuildCanFilters();
+    }
+    if (index == NV_FLAGS) {
+        rebuildCanFilters();
+        setupIdleTick();
+    }
+    if (index == NV_SERVO_SEQUENTIAL) {
+        servoLimitChanged();
+    }
+    buildIoCache();
+    if ((index >= NV_IO_START) || (index == NV_FLAGS)) {
+        // the type or inversion of an input, or the fast input flag, may have changed
+        buildInputMasks();
+    }
+}
+
+/**
+ * Open an NV transaction if one isn't already open.
+ */
+void beginNvTransaction(void) {
+    unsigned char i;
+    
+    if (nvTransaction) return;
+    for (i=1; i<=NV_NUM; i++) {
+        nvShadow[i] = getNodeVar(i);
+    }
+    nvTypeChanged = FALSE;
+    nvEventsChanged = FALSE;
+    nvIoChanged = FALSE;
+    nvLastChange.Val = tickGet();
+    nvTransaction = TRUE;
+}
+
+/**
+ * Write an NV into the Flash image without validation. Within a transaction
+ * it isn't flushed.
+ * @param index
+ * @param value
+ */
+void writeNV(BYTE index, BYTE value) {
+    writeFlashImage((BYTE*)(AT_NV+index), value);
+    if (nvTransaction) {
+        nvShadow[index] = value;
+        // NV_FLAGS holds NV_FLAG_FAST_INPUTS which the input masks depend upon
+        if ((index >= NV_IO_START) || (index == NV_FLAGS)) nvIoChanged = TRUE;
+    }
+}
+
+/**
+ * Get an NV including any uncommitted change.
+ * @param index
+ * @return the value
+ */
+BYTE getPendingNV(BYTE index) {
+    return nvTransaction ? nvShadow[index] : getNodeVar(index);
+}
+
+/**
+ * Validate and apply an NV change within a transaction, opening one if needed.
+ * A type change sets the default NVs and events for the IO straight away so 
+ * that later changes in the same transaction aren't overwritten.
+ * @param index
+ * @param value
+ * @return TRUE if the change was valid
+ */
+BOOL setNvPending(BYTE index, BYTE value) {
+    beginNvTransaction();
+    nvLastChange.Val = tickGet();
+    if ( ! validateNV(index, nvShadow[index], value)) return FALSE;
+    if (IS_NV_TYPE(index)) {
+        if (nvShadow[index] != value) {
+            setType(IO_NV(index), value);
+            nvTypeChanged = TRUE;
+        }
+    } else {
+        writeNV(index, value);
+    }
+    return TRUE;
+}
+
+/**
+ * Record that the taught events have changed, opening a transaction if needed.
+ * The event index and CAN filters are rebuilt once when the transaction is
+ * committed, at the end of the learn session, rather than for each event
+ * taught. The library still flushes its one block Flash image when a write
+ * moves to another block, so taught events only share a Flash write whilst
+ * they fall in the same 64 byte block.
+ */
+void setEventsPending(void) {
+    beginNvTransaction();
+    nvLastChange.Val = tickGet();
+    nvEventsChanged = TRUE;
+}
+
+/**
+ * Flush the changes to Flash and act upon them.
+ */
+void commitNvTransaction(void) {
+    if ( ! nvTransaction) return;
+    // the CPU stalls during the Flash write so it mustn't land in a servo pulse
+    waitServoPulsesDone();
+    flushFlashImage();
+    nvTransaction = FALSE;
+    if (nvTypeChanged || nvEventsChanged) {
+        cancelSequences();
+        rebuildEventIndex();
+    }
+    // the CAN filters may have been enabled or disabled, or the events changed
+    rebuildCanFilters();
+    // IDLE may have been enabled or disabled
+    setupIdleTick();
+    // the sequential limit may have been raised
+    servoLimitChanged();
+    buildIoCache();
+    if (nvIoChanged) {
+        // the type or inversion of an input, or the fast input flag, may have changed
+        buildInputMasks();
+    }
+}
+
+/**
+ * Commit a transaction which has had no changes for NV_TRANSACTION_IDLE, or 
+ * LEARN_TRANSACTION_IDLE in learn mode. A learn session is normally committed
+ * by the NNULN which ends it.
+ */
+void pollNvTransaction(void) {
+    if ( ! nvTransaction) return;
+    if ( ! servoPulsesDone()) return;   // commit in the gap between servo blocks
+    if (tickTimeSince(nvLastChange) > 
+            ((flimState == fsFLiMLearn) ? LEARN_TRANSACTION_IDLE : NV_TRANSACTION_IDLE)) {
+        commitNvTransaction();
+    }
+}
+
+/**
+ * Convert an old speed to 1/8 position per 20ms, the fastest is 255.
+ */
+static BYTE upgradeSpeed(BYTE speed) {
+    return (speed > 255/8) ? 255 : speed*8;
+}
+
+/**
+ * Convert the NVs of a module which was running a firmware with an older NV
+ * layout. Called at power up before anything uses the NVs, so the Flash image
+ * is flushed directly rather than in a transaction.
+ */
+void upgradeNVs(void) {
+    BYTE version = ee_read((WORD)EE_NV_VERSION);
+    unsigned char i;
+    
+    if (version == 0xFF) version = 1;
+    if (version >= NV_VERSION) return;
+    if (version < 2) {
+        writeNV(NV_SERVO_SPEED, upgradeSpeed(nodeVarTable.moduleNVs.servo_speed));
+        for (i=0; i<NUM_IO; i++) {
+            if (nodeVarTable.moduleNVs.io[i].type == TYPE_SERVO) {
+                writeNV(NV_IO_SERVO_SE_SPEED(i), upgradeSpeed(nodeVarTable.moduleNVs.io[i].nv_io.nv_servo.servo_se_speed));
+                writeNV(NV_IO_SERVO_ES_SPEED(i), upgradeSpeed(nodeVarTable.moduleNVs.io[i].nv_io.nv_servo.servo_es_speed));
+            }
+        }
     }
+    flushFlashImage();
+    ee_write((WORD)EE_NV_VERSION, NV_VERSION);
 }
 
 /**
@@ -90,31 +295,31 @@ void defaultNVs(unsigned char i, unsigned char type) {
     // add the module's default nv for this io
     switch(type) {
         case TYPE_INPUT:
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_INPUT_ENABLE_OFF(i)), 0);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_INPUT_INVERTED(i)), 0);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_INPUT_ON_DELAY(i)), 0);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_INPUT_OFF_DELAY(i)), 0);
+            writeNV(NV_IO_INPUT_ENABLE_OFF(i), 0);
+            writeNV(NV_IO_INPUT_INVERTED(i), 0);
+            writeNV(NV_IO_INPUT_ON_DELAY(i), 0);
+            writeNV(NV_IO_INPUT_OFF_DELAY(i), 0);
             break;
         case TYPE_OUTPUT:
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_OUTPUT_PULSE_DURATION(i)), 0);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_OUTPUT_INVERTED(i)), 0);
+            writeNV(NV_IO_OUTPUT_PULSE_DURATION(i), 0);
+            writeNV(NV_IO_OUTPUT_INVERTED(i), 0);
             break;
         case TYPE_SERVO:
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_SERVO_START_POS(i)), 25);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_SERVO_END_POS(i)), 200);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_SERVO_SE_SPEED(i)), 5);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_SERVO_ES_SPEED(i)), 5);
+            writeNV(NV_IO_SERVO_START_POS(i), 25);
+            writeNV(NV_IO_SERVO_END_POS(i), 200);
+            writeNV(NV_IO_SERVO_SE_SPEED(i), 40);
+            writeNV(NV_IO_SERVO_ES_SPEED(i), 40);
             break;
         case TYPE_BOUNCE:
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_BOUNCE_START_POS(i)), 0);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_BOUNCE_END_POS(i)), 90);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_BOUNCE_PROFILE(i)), 1);
+            writeNV(NV_IO_BOUNCE_START_POS(i), 0);
+            writeNV(NV_IO_BOUNCE_END_POS(i), 90);
+            writeNV(NV_IO_BOUNCE_PROFILE(i), 1);
             break;
         case TYPE_MULTI:
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_MULTI_NUM_POS(i)), 3);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_MULTI_POS1(i)), 25);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_MULTI_POS2(i)), 110);
-            writeFlashImage((BYTE*)(AT_NV+NV_IO_MULTI_POS3(i)), 200);
+            writeNV(NV_IO_MULTI_NUM_POS(i), 3);
+            writeNV(NV_IO_MULTI_POS1(i), 25);
+            writeNV(NV_IO_MULTI_POS2(i), 110);
+            writeNV(NV_IO_MULTI_POS3(i), 200);
             break;
     }
 }
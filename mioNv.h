@@ -28,43 +28,49 @@ extern "C" {
 #define NV_SOD_DELAY                    1
 #define NV_HB_DELAY                     2  
 #define NV_SERVO_CUTOFF                 3
-#define NV_SERVO_STARTUP_B1             4
-#define NV_SERVO_STARTUP_B2             5
-#define NV_SERVO_SEQUENTIAL             6
-#define NV_SERVO_SPEED                  7   // Used for Multi and Bounce types where there isn't an NV to define speed.
-#define NV_SPARE1                       8
-#define NV_SPARE2                       9
-#define NV_SPARE3                       10
-#define NV_SPARE4                       11
-#define NV_SPARE5                       12
+#define NV_SERVO_STARTUP_B1             4   // number of outputs restored together at power up, 0 for all at once
+#define NV_SERVO_STARTUP_B2             5   // gap between the power up groups in 100ms
+#define NV_SERVO_SEQUENTIAL             6   // maximum number of servos moving at once, 0 for no limit
+#define NV_SERVO_SPEED                  7   // Used for Multi and Bounce types where there isn't an NV to define speed. 1/8 position per 20ms
+#define NV_FLAGS                        8   // Module option flags, see NV_FLAG_xxx
+#define NV_RX_BUDGET                    9   // maximum CAN frames handled per main loop pass, 0 for 1
+#define NV_SOD_GAP                      10  // gap in ms between the state report events sent on a consumed SoD
+#define NV_INPUT_REFILL                 11  // time in 10ms for an input to earn another event, 0 for no rate limit
+#define NV_INPUT_BURST                  12  // number of events an input can send in a burst
 #define NV_SPARE6                       13
 #define NV_SPARE7                       14
 #define NV_SPARE8                       15
 #define NV_IO_START                     16
 #define NVS_PER_IO                      6
+
+// Module option flags in NV_FLAGS
+#define NV_FLAG_FAST_INPUTS             0x01    // use interrupt on change for inputs on RB0, RB1, RB4, RB5
+#define NV_FLAG_FAST_SERVOS             0x02    // shorten the servo frame to refresh at up to 200Hz (digital servos)
+#define NV_FLAG_IDLE                    0x04    // put the CPU into IDLE when there is nothing to do
+#define NV_FLAG_CAN_FILTERS             0x08    // reject events not consumed with the ECAN acceptance filters
     
 // NVs per IO
 #define NV_IO_TYPE(i)                   (NV_IO_START + NVS_PER_IO*(i))
 #define NV_IO_INPUT_ENABLE_OFF(i)       (NV_IO_START + NVS_PER_IO*(i) + 1)
 #define NV_IO_INPUT_INVERTED(i)         (NV_IO_START + NVS_PER_IO*(i) + 2)
-#define NV_IO_INPUT_ON_DELAY(i)         (NV_IO_START + NVS_PER_IO*(i) + 3)
-#define NV_IO_INPUT_OFF_DELAY(i)        (NV_IO_START + NVS_PER_IO*(i) + 4)
-#define NV_IO_OUTPUT_PULSE_DURATION(i)  (NV_IO_START + NVS_PER_IO*(i) + 1)
+#define NV_IO_INPUT_ON_DELAY(i)         (NV_IO_START + NVS_PER_IO*(i) + 3)   // in ms
+#define NV_IO_INPUT_OFF_DELAY(i)        (NV_IO_START + NVS_PER_IO*(i) + 4)   // in ms
+#define NV_IO_OUTPUT_PULSE_DURATION(i)  (NV_IO_START + NVS_PER_IO*(i) + 1)   // in 10ms, 0 for not pulsed
 #define NV_IO_OUTPUT_INVERTED(i)        (NV_IO_START + NVS_PER_IO*(i) + 2)
 #define NV_IO_SERVO_START_POS(i)        (NV_IO_START + NVS_PER_IO*(i) + 1)
 #define NV_IO_SERVO_END_POS(i)          (NV_IO_START + NVS_PER_IO*(i) + 2)
-#define NV_IO_SERVO_SE_SPEED(i)         (NV_IO_START + NVS_PER_IO*(i) + 3)
-#define NV_IO_SERVO_ES_SPEED(i)         (NV_IO_START + NVS_PER_IO*(i) + 4)
+#define NV_IO_SERVO_SE_SPEED(i)         (NV_IO_START + NVS_PER_IO*(i) + 3)   // 1/8 position per 20ms, 0 for immediate
+#define NV_IO_SERVO_ES_SPEED(i)         (NV_IO_START + NVS_PER_IO*(i) + 4)   // 1/8 position per 20ms, 0 for immediate
 #define NV_IO_BOUNCE_START_POS(i)       (NV_IO_START + NVS_PER_IO*(i) + 1)
 #define NV_IO_BOUNCE_END_POS(i)         (NV_IO_START + NVS_PER_IO*(i) + 2)
-#define NV_IO_BOUNCE_PROFILE(i)         (NV_IO_START + NVS_PER_IO*(i) + 3)
+#define NV_IO_BOUNCE_PROFILE(i)         (NV_IO_START + NVS_PER_IO*(i) + 3)   // 0 none, 1 bounce, 2 semaphore, 3 ease
 #define NV_IO_MULTI_NUM_POS(i)          (NV_IO_START + NVS_PER_IO*(i) + 1)
 #define NV_IO_MULTI_POS1(i)             (NV_IO_START + NVS_PER_IO*(i) + 2)
 #define NV_IO_MULTI_POS2(i)             (NV_IO_START + NVS_PER_IO*(i) + 3)
 #define NV_IO_MULTI_POS3(i)             (NV_IO_START + NVS_PER_IO*(i) + 4)
 #define NV_IO_MULTI_POS4(i)             (NV_IO_START + NVS_PER_IO*(i) + 5)
 
-#define IS_NV_TYPE(i)                   (((i-NV_IO_START) % NVS_PER_IO) == 0)
+#define IS_NV_TYPE(i)                   (((i) >= NV_IO_START) && (((i-NV_IO_START) % NVS_PER_IO) == 0))
 #define IO_NV(i)                        ((i-NV_IO_START)/NVS_PER_IO)
   
 // the types
@@ -115,13 +121,27 @@ typedef struct {
         BYTE sendSodDelay;               // Time after start in 100mS (plus 2 seconds) to send an automatic SoD. Set to zero for no auto SoD
         BYTE hbDelay;                    // Interval in 100mS for automatic heartbeat. Set to zero for no heartbeat.
         BYTE cutoff;                  // whether servos stop when they reach their destination
-        WORD startup;                 // ??
-        BYTE sequential;              // whether outputs change sequentially or all together
+        BYTE startupGroup;            // outputs restored together at power up, 0 for all
+        BYTE startupGap;              // gap between power up groups in 100ms
+        BYTE sequential;              // maximum number of servos moving at once, 0 for all together
         BYTE servo_speed;               // default servo speed
-        BYTE spare[8];
+        BYTE flags;                     // module option flags
+        BYTE rxBudget;                  // maximum CAN frames handled per main loop pass
+        BYTE sodGap;                    // gap in ms between state report events
+        BYTE inputRefill;               // input rate limit, 10ms to earn another event
+        BYTE inputBurst;                // input rate limit, bucket size
+        BYTE spare[3];
         NvIo io[NUM_IO];                 // config for each IO
 } ModuleNvDefs;
 
+/*
+ * The NV layout version, kept in EEPROM so that the NVs of a module which was
+ * running an older firmware can be converted.
+ * 1 (0xFF in EEPROM) speeds in whole positions per 20ms
+ * 2 speeds in 1/8 position per 20ms
+ */
+#define NV_VERSION  2
+
 #define NV_NUM  sizeof(ModuleNvDefs)     // Number of node variables
 #define AT_NV   0x7F80                  // Where the NVs are stored. (_ROMSIZE - 128)  Size=128 bytes
 
@@ -130,6 +150,24 @@ extern void setNodeVar(unsigned int index, unsigned int value);
 extern BOOL validateNV(BYTE nvIndex, BYTE oldValue, BYTE value);
 void actUponNVchange(unsigned char index, unsigned char value);
 extern void defaultNVs(unsigned char i, unsigned char type);        
+extern void upgradeNVs(void);
+
+/*
+ * NV transactions. Many NV changes are written into the Flash image and acted
+ * upon once when the transaction is committed. The library's Flash image holds
+ * one 64 byte block and is flushed whenever a write moves to another block, so
+ * a transaction makes one Flash write per block switch plus one at the commit.
+ * The event changes of a learn session are combined into the same transaction.
+ */
+#define NV_TRANSACTION_IDLE     ONE_SECOND      // commit after this long without a change
+#define LEARN_TRANSACTION_IDLE  (5*ONE_SECOND)  // the same whilst in learn mode
+extern void beginNvTransaction(void);
+extern BOOL setNvPending(BYTE index, BYTE value);
+extern void writeNV(BYTE index, BYTE value);
+extern BYTE getPendingNV(BYTE index);
+extern void setEventsPending(void);
+extern void commitNvTransaction(void);
+extern void pollNvTransaction(void);
 
 
 #ifdef	__cplusplus
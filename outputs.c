@@ -8,30 +8,30 @@
  * Created on 17 April 2017, 13:14
  */
 
+#include <xc.h>
 #include "mioNv.h"
 #include "mioEvents.h"
 #include "../../CBUSlib/FLiM.h"
 #include "config.h"
 #include "../../CBUSlib/GenericTypeDefs.h"
 #include "../../CBUSlib/TickTime.h"
+#include "actionQueue.h"
+#include "stateStore.h"
+#include "ioCache.h"
+#include "perf.h"
 
 // Forward declarations
 void setDigitalOutput(unsigned char io, unsigned char state);
 
 // Externs
-extern Config configs[NUM_IO];
+extern PinPort pinPorts[NUM_IO];
 extern void sendProducedEvent(unsigned char action, BOOL on);
 extern void setServoOutput(unsigned char io, unsigned char state);
 extern void setBounceOutput(unsigned char io, unsigned char state);
 extern void setMultiOutput(unsigned char io, unsigned char state);
-extern void setOuputPin(unsigned char io, BOOL state);
 
-// future state changes
-struct {
-    DWORD when;
-    BOOL state;
-    BOOL active;
-} futures[NUM_IO];
+#define PULSE_UNIT          (10*ONE_MILI_SECOND)    // output_pulse_duration units
+#define FLASH_PERIOD        (500*ONE_MILI_SECOND)   // half period when no pulse duration is set
 
 
 /**
@@ -42,6 +42,17 @@ struct {
  * @param type type of output
  */
 void setOutput(unsigned char io, unsigned char action, unsigned char type) {
+    // a consumed event overrides a power up restore which hasn't happened yet
+    cancelDeferred(io, DEFERRED_RESTORE);
+    if (type != TYPE_INPUT) {
+        // remember the state, a pulsed output ends up OFF
+        if ((type == TYPE_OUTPUT) && (action == ACTION_IO_CONSUMER_1) &&
+                ioConfig[io].nv.nv_io.nv_output.output_pulse_duration) {
+            saveOutputState(io, ACTION_IO_CONSUMER_3);
+        } else {
+            saveOutputState(io, action);
+        }
+    }
     switch(type) {
         case TYPE_INPUT:
             // this should never happen
@@ -61,72 +72,134 @@ void setOutput(unsigned char io, unsigned char action, unsigned char type) {
     }
 }
 
+/**
+ * Restore the outputs to their saved state at power up. The outputs are 
+ * restored in groups of NV_SERVO_STARTUP_B1 with NV_SERVO_STARTUP_B2 between
+ * the groups so that all the servos and relays of a layout don't start 
+ * drawing current at the same moment. IOs without a saved state are left 
+ * alone and don't take a place in a group.
+ * Called from the main loop once the servo tasks are running, so the groups
+ * are spaced from the first servo frame rather than from power up.
+ */
+void restoreOutputs(void) {
+    unsigned char io;
+    BYTE group;
+    BYTE n;
+    DWORD when;
+    
+    group = nodeVarTable.moduleNVs.startupGroup;
+    when = tickGet();
+    n = 0;
+    for (io=0; io<NUM_IO; io++) {
+        if (ioConfig[io].nv.type == TYPE_INPUT) continue;
+        if (getOutputState(io) == NO_STATE) continue;
+        if (group && (n == group)) {
+            when += (DWORD)nodeVarTable.moduleNVs.startupGap * HUNDRED_MILI_SECOND;
+            n = 0;
+        }
+        n++;
+        deferAction(when, DEFERRED_RESTORE, io, 0);
+    }
+}
+
 /**
  * Set a particular output pin to the given state.
  * @param io
  * @param state
  */
 void setOutputPin(unsigned char io, BOOL state) {
-    switch (configs[io].port) {
-        case 'A':
-            if (state) {
-                // set it
-                LATA |= (1<<configs[io].no);
-            } else {
-                // clear it
-                LATA &= ~(1<<configs[io].no);
-            }
-            break;
-        case 'B':
-            if (state) {
-                // set it
-                LATB |= (1<<configs[io].no);
-            } else {
-                // clear it
-                LATB &= ~(1<<configs[io].no);
-            }
-            break;
-        case 'C':
-            if (state) {
-                // set it
-                LATC |= (1<<configs[io].no);
-            } else {
-                // clear it
-                LATC &= ~(1<<configs[io].no);
-            }
-            break;
+    if (state) {
+        // set it
+        PIN_SET(&pinPorts[io]);
+    } else {
+        // clear it
+        PIN_CLEAR(&pinPorts[io]);
     }
 }
 
 /**
- * Set a digital output. Handles inverted outputs and pulsed outputs. Sends the
- * produced events.
- * 
- * TODO pulsed outputs
- * 
+ * Drive a digital output, handling inverted outputs, and send the produced event.
  * @param io
- * @param action
+ * @param state
  */
-void setDigitalOutput(unsigned char io, unsigned char action) {
-    BOOL state;
-    if (action == ACTION_IO_CONSUMER_OUTPUT_ON(io)) {
-        state = TRUE;
-    } else if (action == ACTION_IO_CONSUMER_OUTPUT_OFF(io)) {
-        state == FALSE;
-    } else return;
-    if (NV->io[io].nv_io.nv_output.outout_inverted) {
+static void driveDigitalOutput(unsigned char io, BOOL state) {
+    if (ioConfig[io].nv.nv_io.nv_output.outout_inverted) {
         state = state ? 0:1;
     }
     setOutputPin(io, state);
+    if (perfInEvent) perfLatency(perfEventTime);
     sendProducedEvent(state ? ACTION_IO_PRODUCER_OUTPUT_ON(io):
                 ACTION_IO_PRODUCER_OUTPUT_OFF(io), state);
-    // Was this a ON and we have a pulse duration defined?
-    if (state && nodeVarTable.moduleNVs.io[io].nv_io.nv_output.output_pulse_duration) {
-        // schedule a automatic off
-        futures[io].state = FALSE;
-        futures[io].when = tickGet() + nodeVarTable.moduleNVs.io[io].nv_io.nv_output.output_pulse_duration;
-        futures[io].active = TRUE;
+}
+
+/**
+ * Set a digital output. Handles inverted outputs, pulsed outputs and flashing
+ * outputs. Sends the produced events.
+ * A pulsed output (non zero output_pulse_duration) turns itself off again after
+ * the pulse duration. A flashing output toggles every pulse duration, or every
+ * FLASH_PERIOD if there isn't one, until it is turned ON or OFF. The timing is
+ * done by the deferred action queue.
+ * 
+ * @param io
+ * @param action
+ */
+void setDigitalOutput(unsigned char io, unsigned char action) {
+    BYTE duration;
+    
+    if (action > ACTION_IO_CONSUMER_3) return;
+    cancelDeferred(io, DEFERRED_PULSE_OFF);
+    cancelDeferred(io, DEFERRED_FLASH);
+    pulsingMask &= ~IO_BIT(io);
+    duration = ioConfig[io].nv.nv_io.nv_output.output_pulse_duration;
+    switch (action) {
+        case ACTION_IO_CONSUMER_1:      // ON
+            driveDigitalOutput(io, TRUE);
+            if (duration) {
+                // schedule an automatic off
+                deferAction(tickGet() + duration*PULSE_UNIT, DEFERRED_PULSE_OFF, io, 0);
+                pulsingMask |= IO_BIT(io);
+            }
+            break;
+        case ACTION_IO_CONSUMER_2:      // FLASH
+            driveDigitalOutput(io, TRUE);
+            deferAction(tickGet() + (duration ? duration*PULSE_UNIT : FLASH_PERIOD), DEFERRED_FLASH, io, FALSE);
+            pulsingMask |= IO_BIT(io);
+            break;
+        case ACTION_IO_CONSUMER_3:      // OFF
+            driveDigitalOutput(io, FALSE);
+            break;
     }
 }
 
+/**
+ * Called from the deferred action queue at the end of a pulse.
+ * @param io
+ */
+void endOutputPulse(unsigned char io) {
+    pulsingMask &= ~IO_BIT(io);
+    driveDigitalOutput(io, FALSE);
+}
 
+/**
+ * Called from the deferred action queue for the next toggle of a flashing output.
+ * Produced events are only sent when the flashing is started and stopped.
+ * The next toggle is scheduled from when this one was due rather than from now
+ * so the flashing doesn't drift by the main loop latency of each toggle. If
+ * the module has fallen more than a period behind the flashing restarts from now.
+ * @param io
+ * @param state the new state
+ * @param due the time this toggle was due
+ */
+void toggleFlashingOutput(unsigned char io, BOOL state, DWORD due) {
+    BYTE duration;
+    DWORD period;
+    
+    duration = ioConfig[io].nv.nv_io.nv_output.output_pulse_duration;
+    period = duration ? duration*PULSE_UNIT : FLASH_PERIOD;
+    setOutputPin(io, ioConfig[io].nv.nv_io.nv_output.outout_inverted ? !state : state);
+    due += period;
+    if ((long)(tickGet() - due) >= 0) {
+        due = tickGet() + period;
+    }
+    deferAction(due, DEFERRED_FLASH, io, !state);
+}
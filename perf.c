@@ -0,0 +1,199 @@
+/* 
+ * File:   perf.c
+ * Author: Ian
+ * 
+ * Performance counters so that an overloaded module can be found on a 
+ * layout. The counters are read over CBUS with RDGN, one diagnostic code per 
+ * DGN reply with the value in the two data bytes, and cleared with RDGN 
+ * diagnostic code 0xFF.
+ * 
+ * Times are measured with the free running TMR1 which has 0.25us resolution.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/FLiM.h"
+#include "../../CBUSlib/TickTime.h"
+#include "scheduler.h"
+#include "txQueue.h"
+#include "idle.h"
+#include "perf.h"
+
+// COMSTAT receive overflow bits
+#define COMSTAT_RXB0OVFL    0x80    // mode 0 only, FIFOEMPTY in mode 2
+#define COMSTAT_RXB1OVFL    0x40    // mode 0
+#define COMSTAT_RXBNOVFL    0x40    // modes 1 and 2, any buffer or the FIFO
+
+PerfCounters perf;
+DWORD perfEventTime;
+BOOL perfInEvent = FALSE;
+BYTE servoStartTask = NO_TASK;
+BYTE servoPollTask = NO_TASK;
+
+static WORD loopStart;
+static TickValue loopStartTick;
+
+void resetPerf(void) {
+    unsigned char i;
+    
+    perf.loopMin = 0xFFFF;
+    perf.loopMax = 0;
+    for (i=0; i<PERF_HIST_BINS; i++) {
+        perf.loopHist[i] = 0;
+    }
+    perf.isrMax = 0;
+    perf.canRx = 0;
+    perf.canTx = 0;
+    perf.rxOverflow = 0;
+    perf.lookupHit = 0;
+    perf.lookupMiss = 0;
+    perf.lookupMax = 0;
+    perf.dispatchMax = 0;
+    for (i=0; i<PERF_LATENCY_BINS; i++) {
+        perf.latencyHist[i] = 0;
+    }
+    perf.latencyMax = 0;
+    perf.inputChatter = 0;
+    perf.loopback = 0;
+    txQueueStats.overflows[TX_PRIORITY_HIGH] = 0;
+    txQueueStats.overflows[TX_PRIORITY_LOW] = 0;
+    txQueueStats.txFull = 0;
+    resetTaskStats();
+}
+
+void perfLoopStart(void) {
+    loopStart = TMR1;
+    loopStartTick.Val = tickGet();
+}
+
+void perfLoopEnd(void) {
+    WORD t;
+    DWORD limit;
+    unsigned char bin;
+    BYTE overflow;
+    
+    t = TMR1 - loopStart;
+    if (tickTimeSince(loopStartTick) > 16*ONE_MILI_SECOND) {
+        // TMR1 will have wrapped
+        t = 0xFFFF;
+    }
+    if (t < perf.loopMin) perf.loopMin = t;
+    if (t > perf.loopMax) perf.loopMax = t;
+    // bins go up by a factor of 4 from 4us
+    limit = 16;
+    for (bin=0; bin<PERF_HIST_BINS-1; bin++) {
+        if (t < limit) break;
+        limit <<= 2;
+    }
+    PERF_INC(perf.loopHist[bin]);
+    
+    // RX buffer overflow flags, cleared so the next one is seen. The COMSTAT
+    // bits depend upon the ECAN mode, in mode 2 bit 7 is FIFOEMPTY.
+    if ((ECANCON & 0xC0) == 0) {
+        overflow = COMSTAT & (COMSTAT_RXB0OVFL | COMSTAT_RXB1OVFL);
+    } else {
+        overflow = COMSTAT & COMSTAT_RXBNOVFL;
+    }
+    if (overflow) {
+        PERF_INC(perf.rxOverflow);
+        // single bit clears so no other status bit is written
+        if (overflow & COMSTAT_RXB0OVFL) COMSTAT &= ~COMSTAT_RXB0OVFL;
+        if (overflow & COMSTAT_RXB1OVFL) COMSTAT &= ~COMSTAT_RXB1OVFL;
+    }
+}
+
+void perfIsr(WORD start) {
+    WORD t = TMR1 - start;
+    if (t > perf.isrMax) perf.isrMax = t;
+}
+
+static const BYTE latencyLimits[PERF_LATENCY_BINS-1] = {1, 2, 5, 10, 20, 50};
+
+void perfLatency(DWORD start) {
+    DWORD ms;
+    unsigned char bin;
+    
+    ms = (tickGet() - start) / ONE_MILI_SECOND;
+    if (ms > 0xFFFF) ms = 0xFFFF;
+    if (ms > perf.latencyMax) perf.latencyMax = ms;
+    for (bin=0; bin<PERF_LATENCY_BINS-1; bin++) {
+        if (ms < latencyLimits[bin]) break;
+    }
+    PERF_INC(perf.latencyHist[bin]);
+}
+
+/**
+ * @return the value of a counter
+ */
+static WORD perfValue(BYTE code) {
+    DWORD overflows;
+    
+    if ((code >= PERF_LOOP_HIST) && (code < PERF_LOOP_HIST+PERF_HIST_BINS)) {
+        return perf.loopHist[code - PERF_LOOP_HIST];
+    }
+    if ((code >= PERF_LATENCY_HIST) && (code < PERF_LATENCY_HIST+PERF_LATENCY_BINS)) {
+        return perf.latencyHist[code - PERF_LATENCY_HIST];
+    }
+    if ((code >= PERF_TASK_WORST) && (code < PERF_TASK_WORST+numTasks)) {
+        return (tasks[code - PERF_TASK_WORST].worst > 0xFFFF) ? 0xFFFF : tasks[code - PERF_TASK_WORST].worst;
+    }
+    switch (code) {
+        case 0:
+            return PERF_TASK_WORST + numTasks - 1;
+        case PERF_LOOP_MIN:
+            return perf.loopMin;
+        case PERF_LOOP_MAX:
+            return perf.loopMax;
+        case PERF_ISR_MAX:
+            return perf.isrMax;
+        case PERF_CAN_RX:
+            return perf.canRx;
+        case PERF_CAN_TX:
+            return perf.canTx;
+        case PERF_RX_OVERFLOW:
+            return perf.rxOverflow;
+        case PERF_TX_FULL:
+            return txQueueStats.txFull;
+        case PERF_LOOKUP_HIT:
+            return perf.lookupHit;
+        case PERF_LOOKUP_MISS:
+            return perf.lookupMiss;
+        case PERF_LOOKUP_MAX:
+            return perf.lookupMax;
+        case PERF_SERVO_START_MISSED:
+            return (servoStartTask == NO_TASK) ? 0 : tasks[servoStartTask].missed;
+        case PERF_SERVO_POLL_MISSED:
+            return (servoPollTask == NO_TASK) ? 0 : tasks[servoPollTask].missed;
+        case PERF_IDLE_DUTY:
+            return idleStats.dutyCycle;
+        case PERF_LATENCY_MAX:
+            return perf.latencyMax;
+        case PERF_DISPATCH_MAX:
+            return perf.dispatchMax;
+        case PERF_INPUT_CHATTER:
+            return perf.inputChatter;
+        case PERF_LOOPBACK:
+            return perf.loopback;
+        case PERF_TX_OVERFLOW:
+            overflows = (DWORD)txQueueStats.overflows[TX_PRIORITY_HIGH] + txQueueStats.overflows[TX_PRIORITY_LOW];
+            return (overflows > 0xFFFF) ? 0xFFFF : overflows;
+    }
+    return 0;
+}
+
+void perfRequest(BYTE * msg) {
+    WORD value;
+    
+    if (msg[d4] == PERF_RESET) {
+        resetPerf();
+        value = 0;
+    } else {
+        value = perfValue(msg[d4]);
+    }
+    // DGN NN, service index, diagnostic code, value hi, value lo
+    msg[d5] = value >> 8;
+    msg[d6] = value & 0xFF;
+    cbusSendOpcMyNN(0, OPC_DGN, msg);
+}
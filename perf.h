@@ -0,0 +1,116 @@
+/* 
+ * File:   perf.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef PERF_H
+#define	PERF_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+#ifndef OPC_RDGN
+#define OPC_RDGN    0x87    // request diagnostics
+#endif
+#ifndef OPC_DGN
+#define OPC_DGN     0xC7    // diagnostic data
+#endif
+
+#define PERF_HIST_BINS      8
+#define PERF_LATENCY_BINS   7
+
+    /*
+     * Times are in TMR1 counts of 0.25us. All counters stick at their maximum.
+     */
+    typedef struct {
+        WORD loopMin;           // main loop pass time
+        WORD loopMax;
+        WORD loopHist[PERF_HIST_BINS];  // <4us, <16us, <64us, <256us, <1ms, <4ms, <16ms, longer
+        WORD isrMax;            // servo high priority ISR time
+        WORD canRx;             // CAN frames received
+        WORD canTx;             // produced events sent
+        WORD rxOverflow;        // CAN receive buffer overflows
+        WORD lookupHit;         // received events which are consumed
+        WORD lookupMiss;
+        WORD lookupMax;         // worst event lookup time
+        WORD dispatchMax;       // worst time to look up and carry out a consumed event
+        WORD latencyHist[PERF_LATENCY_BINS];    // event to output change in ms: <1, <2, <5, <10, <20, <50, longer
+        WORD latencyMax;        // in ms
+        WORD inputChatter;      // input changes held back by the rate limit
+        WORD loopback;          // produced events dispatched locally
+    } PerfCounters;
+    
+    extern PerfCounters perf;
+    
+    /*
+     * The diagnostic codes for RDGN, numbered without gaps. Code 0 returns
+     * the highest code in use, PERF_RESET clears all the counters.
+     */
+#define PERF_LOOP_MIN           1
+#define PERF_LOOP_MAX           2
+#define PERF_LOOP_HIST          3   // 3..10 histogram
+#define PERF_ISR_MAX            11
+#define PERF_CAN_RX             12
+#define PERF_CAN_TX             13
+#define PERF_RX_OVERFLOW        14
+#define PERF_TX_FULL            15
+#define PERF_LOOKUP_HIT         16
+#define PERF_LOOKUP_MISS        17
+#define PERF_LOOKUP_MAX         18
+#define PERF_SERVO_START_MISSED 19
+#define PERF_SERVO_POLL_MISSED  20
+#define PERF_IDLE_DUTY          21
+#define PERF_TX_OVERFLOW        22
+#define PERF_DISPATCH_MAX       23
+#define PERF_LATENCY_HIST       24  // 24..30 event to output latency histogram
+#define PERF_LATENCY_MAX        31
+#define PERF_INPUT_CHATTER      32
+#define PERF_LOOPBACK           33
+#define NUM_PERF_CODES          33
+#define PERF_TASK_WORST         (NUM_PERF_CODES+1)  // 34..34+numTasks-1 worst run time of each scheduler task, in ticks
+#define PERF_RESET              0xFF
+
+#define PERF_INC(c)             do { if ((c) != 0xFFFF) (c)++; } while (0)
+
+    extern void resetPerf(void);
+    /**
+     * Mark the start and end of the work in a main loop pass.
+     */
+    extern void perfLoopStart(void);
+    extern void perfLoopEnd(void);
+    /**
+     * Record the time of a servo ISR which started at TMR1 value start.
+     */
+    extern void perfIsr(WORD start);
+    /**
+     * The time the consumed event being processed was received, valid whilst
+     * perfInEvent is TRUE.
+     */
+    extern DWORD perfEventTime;
+    extern BOOL perfInEvent;
+    /**
+     * Record the latency from receiving an event, received at tick time start,
+     * to the output changing.
+     */
+    extern void perfLatency(DWORD start);
+    /**
+     * The scheduler task numbers of the servo tasks, for their missed counts.
+     */
+    extern BYTE servoStartTask;
+    extern BYTE servoPollTask;
+    /**
+     * Handle an RDGN request for this node.
+     */
+    extern void perfRequest(BYTE * msg);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PERF_H */
+
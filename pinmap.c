@@ -0,0 +1,30 @@
+/*
+ * File:   pinmap.c
+ * Author: Ian
+ *
+ * The per IO pin tables generated from the board's PIN_MAP in pinmap.h.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "canmio.h"
+#include "config.h"
+#include "pinmap.h"
+
+const BYTE ioPortIndex[NUM_IO] = {
+    PIN_MAP(PIN_PORT_INDEX)
+};
+
+const BYTE ioBitNo[NUM_IO] = {
+    PIN_MAP(PIN_BIT_NO)
+};
+
+/*
+ * The resolved LAT/PORT registers and masks for each IO. Kept in RAM as the 
+ * servo ISR sets and clears the pins through these.
+ */
+PinPort pinPorts[NUM_IO] = {
+    PIN_MAP(PIN_PORT_ENTRY)
+};
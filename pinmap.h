@@ -0,0 +1,97 @@
+/*
+ * File:   pinmap.h
+ * Author: Ian
+ *
+ * The mapping between IO number, PIC pin and port/bit for each board variant.
+ *
+ * Each board is an X-macro table of PIN(io, pin, port, bit) entries in IO
+ * order. The board is chosen at compile time by setting BOARD to one of the
+ * BOARD_xxx numbers in the project's preprocessor macros, CANMIO if BOARD
+ * isn't defined. The tables and masks below are all generated from the
+ * selected PIN_MAP so nothing has to decode a port at run time. A new board
+ * variant just needs a new table.
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef PINMAP_H
+#define	PINMAP_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "canmio.h"
+
+    // CANMIO, PIC18F25K80
+#define CANMIO_PIN_MAP(PIN) \
+    PIN(0,  18, C, 7) \
+    PIN(1,  17, C, 6) \
+    PIN(2,  16, C, 5) \
+    PIN(3,  15, C, 4) \
+    PIN(4,  14, C, 3) \
+    PIN(5,  13, C, 2) \
+    PIN(6,  12, C, 1) \
+    PIN(7,  11, C, 0) \
+    PIN(8,  21, B, 0) \
+    PIN(9,  22, B, 1) \
+    PIN(10, 25, B, 4) \
+    PIN(11, 26, B, 5) \
+    PIN(12, 3,  A, 1) \
+    PIN(13, 2,  A, 0) \
+    PIN(14, 5,  A, 3) \
+    PIN(15, 7,  A, 5)
+
+    /*
+     * Select the board's table. The project's preprocessor macros set BOARD
+     * to one of the BOARD_xxx numbers, e.g. BOARD=BOARD_CANMIO. CANMIO is the
+     * default only when BOARD isn't defined at all, any other value is an
+     * error. A new variant is another BOARD_xxx number and #elif entry.
+     */
+#define BOARD_CANMIO    1
+
+#if !defined(BOARD)
+#define PIN_MAP(PIN)    CANMIO_PIN_MAP(PIN)     // no board chosen
+#elif BOARD == BOARD_CANMIO
+#define PIN_MAP(PIN)    CANMIO_PIN_MAP(PIN)
+#else
+#error "unknown BOARD_xxx"
+#endif
+
+    // The ports used by the IOs
+#define NUM_PORTS   3
+#define PORT_A      0
+#define PORT_B      1
+#define PORT_C      2
+
+    /*
+     * Initialisers for tables indexed by IO.
+     */
+#define PIN_PORT_INDEX(io, pin, port, bit)  PORT_##port,
+#define PIN_BIT_NO(io, pin, port, bit)      bit,
+#define PIN_PORT_ENTRY(io, pin, port, bit)  {&LAT##port, &PORT##port, 1 << (bit), (unsigned char)~(1 << (bit))},
+
+    /*
+     * The bits of each port which are used by an IO. Other bits of the port
+     * such as the CAN and LED pins must be left alone.
+     */
+#define PIN_IF_PORT(p, port, bit)           ((PORT_##port == (p)) ? (1 << (bit)) : 0)
+#define PIN_ON_A(io, pin, port, bit)        PIN_IF_PORT(PORT_A, port, bit) |
+#define PIN_ON_B(io, pin, port, bit)        PIN_IF_PORT(PORT_B, port, bit) |
+#define PIN_ON_C(io, pin, port, bit)        PIN_IF_PORT(PORT_C, port, bit) |
+#define IO_PINS_A                           ((BYTE)(PIN_MAP(PIN_ON_A) 0))
+#define IO_PINS_B                           ((BYTE)(PIN_MAP(PIN_ON_B) 0))
+#define IO_PINS_C                           ((BYTE)(PIN_MAP(PIN_ON_C) 0))
+
+    /*
+     * Generated from PIN_MAP in pinmap.c
+     */
+    extern const BYTE ioPortIndex[NUM_IO];  // PORT_x of each IO
+    extern const BYTE ioBitNo[NUM_IO];      // bit number of each IO within its port
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PINMAP_H */
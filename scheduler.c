@@ -0,0 +1,75 @@
+/* 
+ * File:   scheduler.c
+ * Author: Ian
+ * 
+ * A small cooperative scheduler for the periodic work done from the main loop.
+ * Each task has an absolute deadline which is advanced by exactly its period
+ * after it runs, so the period doesn't drift however long the rest of the
+ * loop takes. A late task is run on the following passes until it has caught
+ * up, or resynchronised if it is more than MAX_TASK_CATCHUP periods behind.
+ * 
+ * The longest run time of each task and the number of deadlines missed by a
+ * whole period or more are recorded so the task using up the loop budget can
+ * be found.
+ *
+ * Created on 14 October 2026
+ */
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/TickTime.h"
+#include "scheduler.h"
+
+Task tasks[MAX_TASKS];
+BYTE numTasks;
+
+void initScheduler(void) {
+    numTasks = 0;
+}
+
+BYTE addTask(TaskFunction function, DWORD period) {
+    Task * t;
+    
+    if (numTasks >= MAX_TASKS) return NO_TASK;
+    t = &tasks[numTasks];
+    t->function = function;
+    t->period = period;
+    t->next = tickGet() + period;
+    t->worst = 0;
+    t->missed = 0;
+    return numTasks++;
+}
+
+void runTasks(void) {
+    unsigned char i;
+    Task * t;
+    DWORD now;
+    DWORD ran;
+    
+    for (i=0; i<numTasks; i++) {
+        t = &tasks[i];
+        now = tickGet();
+        if ((long)(now - t->next) < 0) continue;
+        t->function();
+        ran = tickGet() - now;
+        if (ran > t->worst) t->worst = ran;
+        if (t->period == 0) continue;
+        if ((now - t->next) >= t->period) {
+            // started a whole period or more after the deadline
+            t->missed++;
+            if ((now - t->next) >= MAX_TASK_CATCHUP*t->period) {
+                // too far behind so resynchronise
+                t->next = now;
+            }
+        }
+        t->next += t->period;
+    }
+}
+
+void resetTaskStats(void) {
+    unsigned char i;
+    
+    for (i=0; i<numTasks; i++) {
+        tasks[i].worst = 0;
+        tasks[i].missed = 0;
+    }
+}
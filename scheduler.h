@@ -0,0 +1,56 @@
+/* 
+ * File:   scheduler.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef SCHEDULER_H
+#define	SCHEDULER_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+#define MAX_TASKS           12
+#define MAX_TASK_CATCHUP    4   // periods a late task may catch up before it is resynchronised
+#define NO_TASK             0xFF
+
+    typedef void (*TaskFunction)(void);
+    
+    typedef struct {
+        TaskFunction function;
+        DWORD period;           // in ticks, 0 to run on every pass of the main loop
+        DWORD next;             // absolute deadline of the next run
+        DWORD worst;            // longest run time in ticks
+        WORD missed;            // runs which started a whole period or more late
+    } Task;
+    
+    extern Task tasks[MAX_TASKS];
+    extern BYTE numTasks;
+
+    extern void initScheduler(void);
+    /**
+     * Add a periodic task. The first run is due one period from now.
+     * @param function the task
+     * @param period in ticks
+     * @return the task number or NO_TASK if the table is full
+     */
+    extern BYTE addTask(TaskFunction function, DWORD period);
+    /**
+     * Run every task whose deadline has passed. Called every pass of the main loop.
+     */
+    extern void runTasks(void);
+    /**
+     * Clear the worst run time and missed counters.
+     */
+    extern void resetTaskStats(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SCHEDULER_H */
+
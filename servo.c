@@ -3,252 +3,710 @@
  * Author: Ian
  * 
  * Handle the servo outputs. The output signal is a pulse between 1ms and 2ms where the width of the
- * pulse results in the servo moving to an angle. The outputs are driven by Timers to ensure that the
- * pulse width is accurate - although if interrupts are disabled then the width could be longer than
- * intended.
- * Pulses are output approximately every 20ms. Therefore we need more than 1 timer for all 16 possible 
- * servo outputs (16 * 2ms = 32ms which is greater than the 20ms available). A minimum of 2 timers 
+ * pulse results in the servo moving to an angle. The outputs are driven by the CCP compare hardware to
+ * ensure that the pulse width is accurate - although if interrupts are disabled then the width could be
+ * longer than intended.
+ * Pulses are output approximately every 20ms. Therefore we need more than 1 channel for all 16 possible 
+ * servo outputs (16 * 2ms = 32ms which is greater than the 20ms available). A minimum of 2 channels 
  * (each handling 8 servos) is required but if we allow overdrive beyond 2ms then 3 (6 servos) or 
- * 4 (4 servos) timers is better.
- * Here we use 4 timers. Timer1..Timer4.
+ * 4 (4 servos) channels is better.
+ * Here we use 4 channels, each one of the CCP2..CCP5 modules in compare mode.
  * 
- * The timers are driven from Fosc/4 and use a 1:4 prescalar. With a 16MHz resonator and 4x PLL this 
+ * Timer1 runs continuously as the time base for all 4 CCP channels. At the start of a pulse the 
+ * output is set and the CCP compare register is loaded with Timer1 plus the pulse width. The
+ * compare match interrupt then clears the output, so each pulse costs exactly one interrupt.
+ * 
+ * Timer1 is driven from Fosc/4 and uses a 1:4 prescalar. With a 16MHz resonator and 4x PLL this 
  * equates to a timer increment every 0.25us. We require counts from 1ms to 2ms or 4000 - 8000 timer ticks.
  * We have an 8 bit position value and actually want to allow a bit of overdrive of the servo 0.9ms - 2.1ms.
  * (3600 ticks - 8400 ticks). This gives a range of 4800 ticks over the 8 bit range. Therefore each value
  * of the position is equivalent to 18.75 ticks - let's call it 19. The 3600 ticks at position 0 so to 
  * convert from position to ticks we need to use:
  *    Ticks = 3600 + 19 * position 
- * This is fine for the 16bit Timer1 and Timer3 but the 8 bit timers Timer2 and Timer4 need a bit more work.
+ * This is precalculated in the pos2Ticks table.
  * 
  *
  * Created on 17 April 2017, 13:14
  */
 #include <xc.h>
+#include <stddef.h>
 #include "mioNv.h"
 #include "mioEvents.h"
 #include "../../CBUSlib/FLiM.h"
 #include "config.h"
 #include "../../CBUSlib/GenericTypeDefs.h"
 #include "../../CBUSlib/TickTime.h"
+#include "stateStore.h"
+#include "ioCache.h"
+#include "perf.h"
 
 #define POS2TICK_OFFSET         3600    // change this to affect the min pulse width
 #define POS2TICK_MULTIPLIER     19      // change this to affect the max pulse width
+#define NUM_SERVO_CHANNELS      4
+
+/*
+ * The pulse width in Timer1 ticks for each position. 
+ * pos2Ticks[p] = POS2TICK_OFFSET + POS2TICK_MULTIPLIER * p
+ */
+static const WORD pos2Ticks[256] = {
+    3600, 3619, 3638, 3657, 3676, 3695, 3714, 3733,
+    3752, 3771, 3790, 3809, 3828, 3847, 3866, 3885,
+    3904, 3923, 3942, 3961, 3980, 3999, 4018, 4037,
+    4056, 4075, 4094, 4113, 4132, 4151, 4170, 4189,
+    4208, 4227, 4246, 4265, 4284, 4303, 4322, 4341,
+    4360, 4379, 4398, 4417, 4436, 4455, 4474, 4493,
+    4512, 4531, 4550, 4569, 4588, 4607, 4626, 4645,
+    4664, 4683, 4702, 4721, 4740, 4759, 4778, 4797,
+    4816, 4835, 4854, 4873, 4892, 4911, 4930, 4949,
+    4968, 4987, 5006, 5025, 5044, 5063, 5082, 5101,
+    5120, 5139, 5158, 5177, 5196, 5215, 5234, 5253,
+    5272, 5291, 5310, 5329, 5348, 5367, 5386, 5405,
+    5424, 5443, 5462, 5481, 5500, 5519, 5538, 5557,
+    5576, 5595, 5614, 5633, 5652, 5671, 5690, 5709,
+    5728, 5747, 5766, 5785, 5804, 5823, 5842, 5861,
+    5880, 5899, 5918, 5937, 5956, 5975, 5994, 6013,
+    6032, 6051, 6070, 6089, 6108, 6127, 6146, 6165,
+    6184, 6203, 6222, 6241, 6260, 6279, 6298, 6317,
+    6336, 6355, 6374, 6393, 6412, 6431, 6450, 6469,
+    6488, 6507, 6526, 6545, 6564, 6583, 6602, 6621,
+    6640, 6659, 6678, 6697, 6716, 6735, 6754, 6773,
+    6792, 6811, 6830, 6849, 6868, 6887, 6906, 6925,
+    6944, 6963, 6982, 7001, 7020, 7039, 7058, 7077,
+    7096, 7115, 7134, 7153, 7172, 7191, 7210, 7229,
+    7248, 7267, 7286, 7305, 7324, 7343, 7362, 7381,
+    7400, 7419, 7438, 7457, 7476, 7495, 7514, 7533,
+    7552, 7571, 7590, 7609, 7628, 7647, 7666, 7685,
+    7704, 7723, 7742, 7761, 7780, 7799, 7818, 7837,
+    7856, 7875, 7894, 7913, 7932, 7951, 7970, 7989,
+    8008, 8027, 8046, 8065, 8084, 8103, 8122, 8141,
+    8160, 8179, 8198, 8217, 8236, 8255, 8274, 8293,
+    8312, 8331, 8350, 8369, 8388, 8407, 8426, 8445,
+};
 
 // forward definitions
-void setupTimer1(unsigned char io);
-void setupTimer2(unsigned char io);
-void setupTimer3(unsigned char io);
-void setupTimer4(unsigned char io);
+void setupChannel(unsigned char channel, unsigned char io);
+BOOL servoPulsesDone(void);
 
 // Externs
-extern Config configs[NUM_IO];
 extern void sendProducedEvent(unsigned char action, BOOL on);
-extern void setOutputPin(unsigned char io, BOOL state);
+extern PinPort pinPorts[NUM_IO];
 
 
+/*
+ * The servo motion engine.
+ * Positions are held as 8.8 fixed point so that speeds of less than one 
+ * position per 20ms frame are possible. The speed NVs are in 1/8 position per
+ * frame. A move accelerates up to the speed over SERVO_RAMP frames and 
+ * then decelerates, starting when the remaining distance is the distance
+ * used to accelerate.
+ */
+#define SPEED_SHIFT         5       // speed NV to 8.8 position per frame
+#define SERVO_RAMP_SHIFT    3       // 8 frames to reach full speed
+
 enum ServoState {
     OFF,            // not generating any pulses
     STOPPED,        // pulse width fixed, reached desired destination
-    MOVING          // pulse width changing
+    MOVING,         // pulse width changing
+    QUEUED          // waiting for the sequential limit to allow it to move
 } servoState[NUM_IO];
-unsigned char currentPos[NUM_IO];
+unsigned char currentPos[NUM_IO];       // the position used for the pulse
 unsigned char targetPos[NUM_IO];
-unsigned char speed[NUM_IO];
+static WORD position[NUM_IO];           // 8.8 fixed point current position
+static WORD velocity[NUM_IO];           // 8.8 positions per frame
+static WORD cruise[NUM_IO];             // the maximum velocity for this move
+static WORD accel[NUM_IO];              // velocity change per frame
+static WORD rampDist[NUM_IO];           // distance travelled whilst accelerating
+static BYTE profile[NUM_IO];            // the bounce profile being played, 0 for none
+static BYTE profileStep[NUM_IO];
+static BYTE profileFrom[NUM_IO];        // the position the profile started from
+static BYTE stopAction[NUM_IO];         // the produced action to send when the move completes
 unsigned char eventFlags[NUM_IO];
 #define EVENT_FLAG_ON       1
 #define EVENT_FLAG_OFF      2
 #define EVENT_FLAG_MID      4
 TickValue  ticksWhenStopped[NUM_IO];
 
+/*
+ * Event to output latency. A move started by a consumed event is timed from
+ * when the event was received until the first pulse at a new position.
+ */
+static WORD latencyMask;            // moves started by an event, not stepped yet
+static WORD latencyStepMask;        // first step done, waiting for the pulse
+static DWORD latencyStart[NUM_IO];
+
+/*
+ * The sequential scheduler. The sequential NV limits the number of servos 
+ * MOVING at once so that the current drawn is bounded, 0 for no limit. Any 
+ * further servos are QUEUED in FIFO order and started as soon as a moving 
+ * servo stops.
+ */
+static BYTE movingCount;
+static BYTE moveQueue[NUM_IO];
+static BYTE moveQueueHead;
+static BYTE moveQueueCount;
+
+/*
+ * The bounce profiles, selected by the bounce_profile NV. Each step is one 20ms
+ * frame and gives the fraction of the travel, where 0 is the start position
+ * and 128 is the destination. Values above 128 overshoot. 
+ */
+static const BYTE profileBounce[] = {       // dropped under gravity, two bounces
+    0, 0, 2, 4, 6, 10, 14, 19, 25, 32, 40, 48,
+    57, 67, 77, 89, 101, 114, 128, 119, 112, 107, 103, 101,
+    100, 101, 103, 107, 112, 119, 128, 124, 121, 120, 121, 124,
+    128
+};
+static const BYTE profileSemaphore[] = {    // overshoot and settle, like a signal arm
+    23, 47, 72, 94, 113, 127, 138, 145, 149, 150, 149, 147,
+    144, 140, 136, 133, 130, 128, 127, 126, 125, 125, 125, 125,
+    126, 126, 127, 127, 128, 128, 128, 128, 128, 128, 128, 128,
+    128, 128, 128, 128
+};
+static const BYTE profileEase[] = {         // ease in, ease out
+    1, 2, 5, 9, 13, 19, 24, 31, 38, 45, 53, 60,
+    68, 75, 83, 90, 97, 104, 109, 115, 119, 123, 126, 127,
+    128
+};
+typedef struct {
+    const BYTE * steps;
+    BYTE length;
+} BounceProfile;
+#define NUM_BOUNCE_PROFILES     4
+static const BounceProfile bounceProfiles[NUM_BOUNCE_PROFILES] = {
+    {NULL, 0},                                  // 0 no profile
+    {profileBounce, sizeof(profileBounce)},     // 1
+    {profileSemaphore, sizeof(profileSemaphore)}, // 2
+    {profileEase, sizeof(profileEase)}          // 3
+};
+
+/*
+ * Frame slot packing. Each 5ms block can start one pulse on each of the
+ * NUM_SERVO_CHANNELS CCP channels. At the start of every frame the active servos
+ * (servo type IOs which aren't OFF) are packed into the slots so that active
+ * servo k is pulsed in block k%frameBlocks on channel k/frameBlocks. With only a
+ * few servos active the higher channels are never started and their interrupts
+ * are left disabled.
+ * Normally a frame is always 4 blocks (20ms, 50Hz). With NV_FLAG_FAST_SERVOS the
+ * frame is only as many blocks as are needed to hold the active servos so up to
+ * 4 servos get 200Hz, up to 8 get 100Hz and so on, for digital servos.
+ */
+#define MAX_FRAME_BLOCKS        4
+#define NO_SLOT                 0xFF
 static unsigned char block;
-static unsigned char timer2Counter; // the High order byte to make T2 16bit
-static unsigned char timer4Counter; // the High order byte to make T4 16bit
+static unsigned char frameBlocks;
+static BYTE slotIo[MAX_FRAME_BLOCKS][NUM_SERVO_CHANNELS];
+/*
+ * The pin currently being pulsed by each channel. Saved when the channel is set up
+ * so the ISR doesn't need to work out the IO or port.
+ */
+static PinPort * channelPins[NUM_SERVO_CHANNELS];
+
+/**
+ * Work out where a servo was left from the last action saved in the state journal.
+ * @param io
+ * @return the position
+ */
+static BYTE restoredPosition(unsigned char io) {
+    BYTE action = getOutputState(io);
+    
+    switch (ioConfig[io].nv.type) {
+        case TYPE_SERVO:
+            if (action == ACTION_IO_CONSUMER_1) return ioConfig[io].nv.nv_io.nv_servo.servo_start_pos;
+            if (action == ACTION_IO_CONSUMER_2) return ioConfig[io].nv.nv_io.nv_servo.servo_end_pos;
+            break;
+        case TYPE_BOUNCE:
+            if (action == ACTION_IO_CONSUMER_1) return ioConfig[io].nv.nv_io.nv_bounce.bounce_start_pos;
+            if (action == ACTION_IO_CONSUMER_2) return ioConfig[io].nv.nv_io.nv_bounce.bounce_end_pos;
+            break;
+        case TYPE_MULTI:
+            switch (action) {
+                case ACTION_IO_CONSUMER_1:
+                    return ioConfig[io].nv.nv_io.nv_multi.multi_pos1;
+                case ACTION_IO_CONSUMER_2:
+                    return ioConfig[io].nv.nv_io.nv_multi.multi_pos2;
+                case ACTION_IO_CONSUMER_3:
+                    return ioConfig[io].nv.nv_io.nv_multi.multi_pos3;
+                case ACTION_IO_CONSUMER_4:
+                    return ioConfig[io].nv.nv_io.nv_multi.multi_pos4;
+            }
+            break;
+    }
+    return 128;     // not known so assume mid travel
+}
 
 void initServos() {
     for (unsigned char io=0; io<NUM_IO; io++) {
         servoState[io] = OFF;
-        currentPos[io] = targetPos[io] = ee_read(EE_OP_STATE-io);   // restore last known positions
-        speed[io] = 0;
+        currentPos[io] = targetPos[io] = restoredPosition(io);   // restore last known positions
+        position[io] = (WORD)currentPos[io] << 8;
+        velocity[io] = 0;
+        profile[io] = 0;
     }
-    block = 3;
-    // initialise the timers for one-shot mode with interrupts and clocked from Fosc/4
+    servoOnMask = 0;
+    movingMask = 0;
+    latencyMask = 0;
+    latencyStepMask = 0;
+    movingCount = 0;
+    moveQueueHead = 0;
+    moveQueueCount = 0;
+    block = MAX_FRAME_BLOCKS-1;
+    frameBlocks = MAX_FRAME_BLOCKS;
+    for (unsigned char c=0; c<NUM_SERVO_CHANNELS; c++) {
+        channelPins[c] = &pinPorts[c];
+    }
+    // Timer1 free running clocked from Fosc/4
     T1GCONbits.TMR1GE = 0;      // gating disabled
     T1CONbits.TMR1CS = 0;       // clock source Fosc/4
     T1CONbits.T1CKPS = 2;       // 1:4 prescalar
-    T1CONbits.SOSCEN = 1;       // clock source Fosc
+    T1CONbits.SOSCEN = 0;       // secondary oscillator not used
     T1CONbits.RD16 = 1;         // 16bit read/write
-    PIE1bits.TMR1IE = 1;        // enable interrupt
-    
-    T2CONbits.T2CKPS = 1;       // 4x prescalar
-                                // only supports Fosc/4 clock source
-    T2CONbits.T2OUTPS = 0;      // 1x postscalar - not used as we get the interrupt before postscalar
-    PIE1bits.TMR2IE = 1;        // enable interrupt
+    PIE1bits.TMR1IE = 0;        // no overflow interrupt
+    T1CONbits.TMR1ON = 1;       // enable Timer1
     
-    T3GCONbits.TMR3GE = 0;      // gating disabled
-    T3CONbits.TMR3CS = 0;       // clock source Fosc/4
-    T3CONbits.T3CKPS = 2;       // 1:4 prescalar
-    T3CONbits.SOSCEN = 1;       // clock source Fosc
-    T3CONbits.RD16 = 1;         // 16bit read/write
-    PIE2bits.TMR3IE = 1;        // enable interrupt
+    // CCP2..CCP5 compare with Timer1, software interrupt on match without driving the CCP pin
+    CCPTMRSbits.C2TSEL = 0;
+    CCPTMRSbits.C3TSEL = 0;
+    CCPTMRSbits.C4TSEL = 0;
+    CCPTMRSbits.C5TSEL = 0;
+    CCP2CON = 0x0A;
+    CCP3CON = 0x0A;
+    CCP4CON = 0x0A;
+    CCP5CON = 0x0A;
+    IPR3bits.CCP2IP = 1;        // high priority
+    IPR4bits.CCP3IP = 1;
+    IPR4bits.CCP4IP = 1;
+    IPR4bits.CCP5IP = 1;
+    PIE3bits.CCP2IE = 0;        // enabled when a pulse is started
+    PIE4bits.CCP3IE = 0;
+    PIE4bits.CCP4IE = 0;
+    PIE4bits.CCP5IE = 0;
+}
+/**
+ * Build the slot table for the next frame from the currently active servos.
+ */
+static void packFrame() {
+    unsigned char active;
+    unsigned char io;
+    unsigned char b;
+    unsigned char c;
+    WORD m;
     
-    T4CONbits.T4CKPS = 1;       // 4x prescalar
-                                // only supports Fosc/4 clock source
-    T4CONbits.T4OUTPS = 0;      // 1x postscalar
-    PIE4bits.TMR4IE = 1;        // enable interrupt
+    for (b=0; b<MAX_FRAME_BLOCKS; b++) {
+        for (c=0; c<NUM_SERVO_CHANNELS; c++) {
+            slotIo[b][c] = NO_SLOT;
+        }
+    }
+    active = 0;
+    for (m=servoOnMask; m; m >>= 1) {
+        if (m & 1) active++;
+    }
+    if (nodeVarTable.moduleNVs.flags & NV_FLAG_FAST_SERVOS) {
+        frameBlocks = (active + NUM_SERVO_CHANNELS - 1)/NUM_SERVO_CHANNELS;
+        if (frameBlocks == 0) frameBlocks = 1;
+    } else {
+        frameBlocks = MAX_FRAME_BLOCKS;
+    }
+    active = 0;
+    for (io=0, m=servoOnMask; m; io++, m >>= 1) {
+        if (m & 1) {
+            slotIo[active % frameBlocks][active / frameBlocks] = io;
+            active++;
+        }
+    }
 }
+
 /**
  * This gets called ever approx 5ms so start the next set of servo pulses.
  * Checks that the servo isn't OFF
  * @param io
  */
 void startServos() {
+    // the last block is still going if the main loop was held up, e.g. by a 
+    // Flash write, so wait rather than cut its pulses short
+    if ( ! servoPulsesDone()) return;
     // increment block before calling setup so that block is left as the current block whilst the
-    // timers expire
+    // pulses complete
     block++;
-    if (block > 3) block = 0;
-    if (nodeVarTable.moduleNVs.io[block*4].type == TYPE_SERVO) {
-        if (servoState[block*4] != OFF) setupTimer1(block*4);
+    if (block >= frameBlocks) {
+        block = 0;
+        packFrame();
     }
-    if (nodeVarTable.moduleNVs.io[block*4+1].type == TYPE_SERVO) {
-        if (servoState[block*4+1] != OFF) setupTimer2(block*4+1);
+    for (unsigned char c=0; c<NUM_SERVO_CHANNELS; c++) {
+        BYTE io = slotIo[block][c];
+        if (io == NO_SLOT) break;   // slots are packed so the rest of the block is empty
+        if (servoState[io] != OFF) setupChannel(c, io);
     }
-    if (nodeVarTable.moduleNVs.io[block*4+2].type == TYPE_SERVO) {
-        if (servoState[block*4+2] != OFF) setupTimer3(block*4+2);
+}
+
+/**
+ * Check whether any servo channel is generating a pulse. Pulses are only 
+ * started by startServos() from the main loop, so once this is TRUE a Flash 
+ * or EEPROM write started from the main loop can't stretch a pulse. The CPU
+ * stall of the write only delays the next block, which servos don't notice.
+ * @return TRUE if no pulse is in progress
+ */
+BOOL servoPulsesDone(void) {
+    return (PIE3bits.CCP2IE || PIE4bits.CCP3IE || PIE4bits.CCP4IE || PIE4bits.CCP5IE) ? FALSE : TRUE;
+}
+
+/**
+ * Wait for the pulses of the current block to end. This is at most the 
+ * longest servo pulse.
+ */
+void waitServoPulsesDone(void) {
+    while ( ! servoPulsesDone())
+        ;
+}
+
+/**
+ * Start the servo output pulse on a channel with the width required for the 
+ * current position. The output is set now and the CCP compare interrupt 
+ * clears it when Timer1 reaches the end of the pulse.
+ * @param channel the servo channel 0..3 (CCP2..CCP5)
+ * @param io
+ */
+void setupChannel(unsigned char channel, unsigned char io) {
+    WORD ticks = pos2Ticks[currentPos[io]];
+    
+    if (latencyStepMask & IO_BIT(io)) {
+        latencyStepMask &= ~IO_BIT(io);
+        perfLatency(latencyStart[io]);
     }
-    if (nodeVarTable.moduleNVs.io[block*4+3].type == TYPE_SERVO) {
-        if (servoState[block*4+3] != OFF) setupTimer4(block*4+3);
+    channelPins[channel] = &pinPorts[io];
+    switch (channel) {
+        case 0:
+            PIR3bits.CCP2IF = 0;
+            PIN_SET(channelPins[0]);
+            CCPR2 = TMR1 + ticks;
+            PIE3bits.CCP2IE = 1;
+            break;
+        case 1:
+            PIR4bits.CCP3IF = 0;
+            PIN_SET(channelPins[1]);
+            CCPR3 = TMR1 + ticks;
+            PIE4bits.CCP3IE = 1;
+            break;
+        case 2:
+            PIR4bits.CCP4IF = 0;
+            PIN_SET(channelPins[2]);
+            CCPR4 = TMR1 + ticks;
+            PIE4bits.CCP4IE = 1;
+            break;
+        case 3:
+            PIR4bits.CCP5IF = 0;
+            PIN_SET(channelPins[3]);
+            CCPR5 = TMR1 + ticks;
+            PIE4bits.CCP5IE = 1;
+            break;
     }
 }
 
 /**
- * The setupTimer start the Timer as a on-shot for the servo output pulse of
- * a width of that required for the required position angle.
- * @param io
+ * These ChannelDone routines are called from the high priority ISR when the 
+ * CCP compare matches at the end of the pulse, so we turn the output pin off 
+ * and disable the interrupt until the next pulse. 
+ * Don't recheck IO type here as it shouldn't be necessary and we want to be as quick as possible.
+ * The pin was resolved when the channel was set up so clearing it takes a fixed time.
  */
-void setupTimer1(unsigned char io) {
-    TMR1 = -(POS2TICK_OFFSET + POS2TICK_MULTIPLIER * currentPos[io]);     // set the duration. Negative to count up to 0x0000 when it generates overflow interrupt
-    // turn on output
-    setOutputPin(io, TRUE);
-    T1CONbits.TMR1ON = 1;       // enable Timer1
+void channel0DoneInterruptHandler() {
+    PIN_CLEAR(channelPins[0]);
+    PIE3bits.CCP2IE = 0;
+    PIR3bits.CCP2IF = 0;
 }
-void setupTimer2(unsigned char io) {
-    TMR2 = 0;                   // start counting at 0
-    WORD ticks = POS2TICK_OFFSET + POS2TICK_MULTIPLIER * currentPos[io];
-    PR2 = ticks & 0xFF;       // set the duration
-    timer2Counter = ticks >> 8;
-    // turn on output
-    setOutputPin(io, TRUE);
-    T2CONbits.TMR2ON =1;        // enable Timer2
+void channel1DoneInterruptHandler() {
+    PIN_CLEAR(channelPins[1]);
+    PIE4bits.CCP3IE = 0;
+    PIR4bits.CCP3IF = 0;
 }
-void setupTimer3(unsigned char io) {
-    TMR3 = -(POS2TICK_OFFSET + POS2TICK_MULTIPLIER * currentPos[io]);     // set the duration. Negative to count up to 0x0000 when it generates overflow interrupt
-    // turn on output
-    setOutputPin(io, TRUE);
-    T3CONbits.TMR3ON = 1;       // enable Timer3
+void channel2DoneInterruptHandler() {
+    PIN_CLEAR(channelPins[2]);
+    PIE4bits.CCP4IE = 0;
+    PIR4bits.CCP4IF = 0;
 }
-void setupTimer4(unsigned char io) {
-    TMR4 = 0;                   // start counting at 0
-    WORD ticks = POS2TICK_OFFSET + POS2TICK_MULTIPLIER * currentPos[io];
-    PR4 = ticks & 0xff;       // set the duration
-    timer4Counter = ticks >> 8;
-    // turn on output
-    setOutputPin(io, TRUE);
-    T4CONbits.TMR4ON =1;        // enable Timer4
+void channel3DoneInterruptHandler() {
+    PIN_CLEAR(channelPins[3]);
+    PIE4bits.CCP5IE = 0;
+    PIR4bits.CCP5IF = 0;
 }
 
 /**
- * These TimerDone routines are called when the on-shot timer expires so we
- * disable the timer and turn the output pin off. 
- * Don't recheck IO type here as it shouldn't be necessary and we want to be as quick as possible.
+ * Change the state of a servo keeping the servoOnMask and movingMask in step.
+ * @param io
+ * @param state
  */
-inline void timer1DoneInterruptHandler() {
-    T1CONbits.TMR1ON = 0;       // disable Timer1
-    setOutputPin(block*4, FALSE);    
+static void setServoState(unsigned char io, enum ServoState state) {
+    servoState[io] = state;
+    if (state == OFF) {
+        servoOnMask &= ~IO_BIT(io);
+    } else {
+        servoOnMask |= IO_BIT(io);
+    }
+    if (state == MOVING) {
+        movingMask |= IO_BIT(io);
+    } else {
+        movingMask &= ~IO_BIT(io);
+    }
 }
-inline void timer2DoneInterruptHandler() {
-    // Is the 16bit counter now at 0?
-    if (timer2Counter == 0) {
-        // stop counting
-        T2CONbits.TMR2ON =0;        // disable Timer2
-        setOutputPin(block*4+1, FALSE);  
+
+/**
+ * Start the servo moving if the sequential limit allows, otherwise queue it.
+ * A servo already moving or queued just continues with its new target.
+ * @param io
+ */
+static void beginMove(unsigned char io) {
+    if (perfInEvent) {
+        latencyStart[io] = perfEventTime;
+        latencyMask |= IO_BIT(io);
+        latencyStepMask &= ~IO_BIT(io);
+    }
+    if ((servoState[io] == MOVING) || (servoState[io] == QUEUED)) return;
+    if ((nodeVarTable.moduleNVs.sequential == 0) || (movingCount < nodeVarTable.moduleNVs.sequential)) {
+        setServoState(io, MOVING);
+        movingCount++;
     } else {
-        // keep counting
-        timer2Counter--;
+        setServoState(io, QUEUED);
+        moveQueue[(moveQueueHead + moveQueueCount) % NUM_IO] = io;
+        moveQueueCount++;
+    }
+}
+
+/**
+ * Start queued servos whilst the sequential limit allows.
+ */
+static void startQueued(void) {
+    unsigned char io;
+    while (moveQueueCount && 
+            ((nodeVarTable.moduleNVs.sequential == 0) || (movingCount < nodeVarTable.moduleNVs.sequential))) {
+        io = moveQueue[moveQueueHead];
+        moveQueueHead = (moveQueueHead + 1) % NUM_IO;
+        moveQueueCount--;
+        if (servoState[io] == QUEUED) {
+            setServoState(io, MOVING);
+            movingCount++;
+        }
+    }
+}
+
+/**
+ * Forget any move of a servo whose IO Type is being changed. Otherwise a
+ * servo retyped part way through a move stays MOVING or QUEUED, beginMove()
+ * ignores it forever and it keeps its NV_SERVO_SEQUENTIAL slot.
+ * @param io
+ */
+void resetServo(unsigned char io) {
+    unsigned char i;
+    unsigned char n;
+    unsigned char q;
+    
+    if (servoState[io] == MOVING) {
+        if (movingCount) movingCount--;
+    }
+    if (servoState[io] == QUEUED) {
+        // take it out of the queue, keeping the order of the others
+        n = 0;
+        for (i=0; i<moveQueueCount; i++) {
+            q = moveQueue[(moveQueueHead + i) % NUM_IO];
+            if (q != io) {
+                moveQueue[(moveQueueHead + n) % NUM_IO] = q;
+                n++;
+            }
+        }
+        moveQueueCount = n;
     }
+    setServoState(io, OFF);
+    latencyMask &= ~IO_BIT(io);
+    latencyStepMask &= ~IO_BIT(io);
+    startQueued();
+}
+
+/**
+ * Called when NV_SERVO_SEQUENTIAL has changed. A raised limit, or no limit,
+ * starts the queued servos which it now allows. A lowered limit lets the
+ * servos already moving finish.
+ */
+void servoLimitChanged(void) {
+    startQueued();
 }
-inline void timer3DoneInterruptHandler() {
-    T3CONbits.TMR3ON = 0;       // disable Timer3t
-    setOutputPin(block*4+2, FALSE);    
+
+/**
+ * Start a servo moving to a position using the motion engine.
+ * @param io
+ * @param target the destination position
+ * @param spd the speed in 1/8 position per frame, 0 to move immediately
+ * @param flags the EVENT_FLAGs for the move
+ * @param action the Produced action to send when the destination is reached
+ */
+static void startMove(unsigned char io, unsigned char target, unsigned char spd, BYTE flags, BYTE action) {
+    targetPos[io] = target;
+    cruise[io] = (WORD)spd << SPEED_SHIFT;
+    accel[io] = cruise[io] >> SERVO_RAMP_SHIFT;
+    if (accel[io] == 0) accel[io] = 1;
+    velocity[io] = 0;
+    rampDist[io] = 0;
+    profile[io] = 0;
+    eventFlags[io] = flags;
+    stopAction[io] = action;
+    beginMove(io);
 }
-inline void timer4DoneInterruptHandler() {
-    // Is the 16bit counter now at 0?
-    if (timer4Counter == 0) {
-        // stop counting
-        T4CONbits.TMR4ON =0;        // disable Timer4
-        setOutputPin(block*4+3, FALSE);
+
+/**
+ * Start a servo playing a bounce profile to a position.
+ * @param io
+ * @param target the destination position
+ * @param prof the bounce profile, must be between 1 and NUM_BOUNCE_PROFILES-1
+ * @param flags the EVENT_FLAGs for the move
+ * @param action the Produced action to send when the profile is complete
+ */
+static void startProfile(unsigned char io, unsigned char target, BYTE prof, BYTE flags, BYTE action) {
+    targetPos[io] = target;
+    profileFrom[io] = currentPos[io];
+    profile[io] = prof;
+    profileStep[io] = 0;
+    eventFlags[io] = flags;
+    stopAction[io] = action;
+    beginMove(io);
+}
+
+/**
+ * The servo has reached its destination.
+ * @param io
+ */
+static void stopServo(unsigned char io) {
+    currentPos[io] = targetPos[io];
+    position[io] = (WORD)targetPos[io] << 8;
+    setServoState(io, STOPPED);
+    ticksWhenStopped[io].Val = tickGet();
+    // send ON event or OFF
+    sendProducedEvent(stopAction[io], (eventFlags[io]&EVENT_FLAG_ON) ? TRUE : FALSE);
+    // let the next queued servo have the slot
+    if (movingCount) movingCount--;
+    startQueued();
+}
+
+/**
+ * Move a servo one frame towards its target, following the acceleration ramp.
+ * @param io
+ */
+static void moveServo(unsigned char io) {
+    WORD target = (WORD)targetPos[io] << 8;
+    WORD remaining;
+    WORD step;
+    BOOL up;
+    BYTE midway;
+    BYTE before;
+    
+    up = (target > position[io]);
+    remaining = up ? target - position[io] : position[io] - target;
+    if (cruise[io] == 0) {
+        // no speed so move immediately
+        velocity[io] = remaining;
+    } else if (remaining <= rampDist[io]) {
+        // decelerate, but keep moving
+        if (velocity[io] > accel[io]) velocity[io] -= accel[io];
+    } else if (velocity[io] < cruise[io]) {
+        // accelerate
+        velocity[io] += accel[io];
+        if (velocity[io] > cruise[io]) velocity[io] = cruise[io];
+        if (rampDist[io] < 0xFFFF - velocity[io]) rampDist[io] += velocity[io];
+    }
+    step = (velocity[io] > remaining) ? remaining : velocity[io];
+    before = currentPos[io];
+    if (up) {
+        position[io] += step;
     } else {
-        // keep counting
-        timer4Counter--;
+        position[io] -= step;
+    }
+    currentPos[io] = position[io] >> 8;
+    if (latencyMask & IO_BIT(io)) {
+        latencyMask &= ~IO_BIT(io);
+        latencyStepMask |= IO_BIT(io);
+    }
+    
+    if (eventFlags[io] & EVENT_FLAG_MID) {
+        midway = ioConfig[io].midway;
+        // passed through midway point
+        // we send an ACON/ACOF depending upon direction servo was moving
+        // This can then be used to drive frog switching relays
+        if (up && (before < midway) && (currentPos[io] >= midway)) {
+            sendProducedEvent(ACTION_IO_PRODUCER_SERVO_MID(io), TRUE);
+        }
+        if (!up && (before > midway) && (currentPos[io] <= midway)) {
+            sendProducedEvent(ACTION_IO_PRODUCER_SERVO_MID(io), FALSE);
+        }
+    }
+    if (step == remaining) {
+        stopServo(io);
+    }
+}
+
+/**
+ * Play the next step of a bounce profile. One table lookup and one 8x8 multiply.
+ * @param io
+ */
+static void playProfile(unsigned char io) {
+    const BounceProfile * prof = &bounceProfiles[profile[io]];
+    BYTE fraction = prof->steps[profileStep[io]];
+    BYTE from = profileFrom[io];
+    BYTE to = targetPos[io];
+    WORD offset;
+    int pos;
+    
+    if (to >= from) {
+        offset = ((WORD)(BYTE)(to - from) * fraction) >> 7;
+        pos = from + offset;
+    } else {
+        offset = ((WORD)(BYTE)(from - to) * fraction) >> 7;
+        pos = from - offset;
+    }
+    if (pos < 0) pos = 0;
+    if (pos > 255) pos = 255;
+    currentPos[io] = pos;
+    position[io] = (WORD)pos << 8;
+    profileStep[io]++;
+    if (latencyMask & IO_BIT(io)) {
+        latencyMask &= ~IO_BIT(io);
+        latencyStepMask |= IO_BIT(io);
+    }
+    if (profileStep[io] >= prof->length) {
+        profile[io] = 0;
+        stopServo(io);
     }
 }
 
 /**
  * This handles the servo state machine and moves the servo towards the required
  * position and generates the Produced events. Called approx every 20ms i.e. 50 times a second.
- * Therefore to move a servo through 200 positions using a speed of 5 will take just under 1 second.
+ * Therefore to move a servo through 200 positions using a speed of 40 i.e. 5 positions 
+ * per frame will take just over 1 second.
  */
 void pollServos() {
-    for (unsigned char io; io<NUM_IO; io++) {
-        int midway = (nodeVarTable.moduleNVs.io[io].nv_io.nv_servo.servo_end_pos + 
-                    nodeVarTable.moduleNVs.io[io].nv_io.nv_servo.servo_start_pos)/2;
-        if (nodeVarTable.moduleNVs.io[io].type == TYPE_SERVO) {
-            BOOL beforeMidway=FALSE;
-            switch (servoState[io]) {
-                case MOVING:
-                    if (targetPos[io] > currentPos[io]) {
-                        if (currentPos[io] < midway) {
-                            beforeMidway = TRUE;
-                        }
-                        currentPos[io] += speed[io];
-                        if (currentPos[io] > targetPos[io]) {
-                            currentPos[io] = targetPos[io];                       }
-                        if ((eventFlags[io] & EVENT_FLAG_MID) && (currentPos[io] >= midway) && beforeMidway) {
-                            // passed through midway point
-                            // we send an ACON/ACOF depending upon direction servo was moving
-                            // This can then be used to drive frog switching relays
-                            sendProducedEvent(ACTION_IO_PRODUCER_SERVO_MID(io), beforeMidway ?TRUE:FALSE);
-                        }
-                    } else if (targetPos[io] < currentPos[io]) {
-                        if (currentPos[io] > midway) {
-                            beforeMidway = TRUE;
-                        }
-                        currentPos[io] -= speed[io];
-                        if (currentPos[io] < targetPos[io]) {
-                            currentPos[io = targetPos[io]];
-                        }
-                        if ((eventFlags[io] & EVENT_FLAG_MID) && (currentPos[io] <= midway) && beforeMidway) {
-                            // passed through midway point
-                            sendProducedEvent(ACTION_IO_PRODUCER_SERVO_MID(io), TRUE);
-                        }
-                    }
-                    if (targetPos[io] == currentPos[io]) {
-                        servoState[io] = STOPPED;
-                        ticksWhenStopped[io].Val = tickGet();
-                        // send ON event or OFF
-                        sendProducedEvent(ACTION_IO_PRODUCER_SERVO_ON(io), (eventFlags[io]&EVENT_FLAG_ON) ? TRUE : FALSE);
-                    }
-                    break;
-                case STOPPED:
-                    // if we have been stopped for more than 1 sec then change to OFF
-                    if (tickTimeSince(ticksWhenStopped[io]) > ONE_SECOND) {
-                        servoState[io] = OFF;
-                    }
-                case OFF:
-                    // output off
-                    // no need to do anything since if output is OFF we don't start the timer in startServos
-                    break;
-            }
+    unsigned char io;
+    WORD m;
+    
+    // only the servos which are generating pulses need any work
+    for (io=0, m=servoOnMask; m; io++, m >>= 1) {
+        if ((m & 1) == 0) continue;
+        switch (servoState[io]) {
+            case MOVING:
+                if (profile[io]) {
+                    playProfile(io);
+                } else {
+                    moveServo(io);
+                }
+                break;
+            case QUEUED:
+                // keep the pulse at the current position until allowed to move
+                break;
+            case STOPPED:
+                // if we have been stopped for more than 1 sec then change to OFF
+                if (tickTimeSince(ticksWhenStopped[io]) > ONE_SECOND) {
+                    setServoState(io, OFF);
+                }
+                break;
+            case OFF:
+                // output off
+                // no need to do anything since if output is OFF we don't start the pulse in startServos
+                break;
         }
     }
 }
@@ -264,29 +722,45 @@ void pollServos() {
 void setServoOutput(unsigned char io, unsigned char action) {
     switch (action) {
         case ACTION_IO_CONSUMER_1:  // SERVO OFF
-            targetPos[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_servo.servo_start_pos;
-            speed[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_servo.servo_es_speed;
-            eventFlags[io] = EVENT_FLAG_OFF & EVENT_FLAG_MID;
-            servoState[io] = MOVING;
+            startMove(io, ioConfig[io].nv.nv_io.nv_servo.servo_start_pos,
+                    ioConfig[io].nv.nv_io.nv_servo.servo_es_speed,
+                    EVENT_FLAG_OFF | EVENT_FLAG_MID, ACTION_IO_PRODUCER_SERVO_ON(io));
             break;
         case ACTION_IO_CONSUMER_2:  // SERVO ON
-            targetPos[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_servo.servo_end_pos;
-            speed[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_servo.servo_se_speed;
-            eventFlags[io] = EVENT_FLAG_ON & EVENT_FLAG_MID;
-            servoState[io] = MOVING;
+            startMove(io, ioConfig[io].nv.nv_io.nv_servo.servo_end_pos,
+                    ioConfig[io].nv.nv_io.nv_servo.servo_se_speed,
+                    EVENT_FLAG_ON | EVENT_FLAG_MID, ACTION_IO_PRODUCER_SERVO_ON(io));
             break;
     }
 }
 
 /**
  * Set a servo output to the required state, producing a bounce at the OFF end.
- * Handles inverted outputs and generates Produced events.
+ * The bounce is played from the profile table selected by bounce_profile. The
+ * move to the ON end uses the motion engine at the default servo speed.
+ * Generates Produced events.
  * 
  * @param io
  * @param action
  */
 void setBounceOutput(unsigned char io, unsigned char action) {
-    // TODO Bounce output type
+    BYTE prof;
+    switch (action) {
+        case ACTION_IO_CONSUMER_1:  // BOUNCE OFF
+            prof = ioConfig[io].nv.nv_io.nv_bounce.bounce_profile;
+            if ((prof > 0) && (prof < NUM_BOUNCE_PROFILES)) {
+                startProfile(io, ioConfig[io].nv.nv_io.nv_bounce.bounce_start_pos,
+                        prof, EVENT_FLAG_OFF, ACTION_IO_PRODUCER_BOUNCE_OFF(io));
+            } else {
+                startMove(io, ioConfig[io].nv.nv_io.nv_bounce.bounce_start_pos,
+                        nodeVarTable.moduleNVs.servo_speed, EVENT_FLAG_OFF, ACTION_IO_PRODUCER_BOUNCE_OFF(io));
+            }
+            break;
+        case ACTION_IO_CONSUMER_2:  // BOUNCE ON
+            startMove(io, ioConfig[io].nv.nv_io.nv_bounce.bounce_end_pos,
+                    nodeVarTable.moduleNVs.servo_speed, EVENT_FLAG_ON, ACTION_IO_PRODUCER_BOUNCE_ON(io));
+            break;
+    }
 }
 
 /**
@@ -297,34 +771,25 @@ void setBounceOutput(unsigned char io, unsigned char action) {
 void setMultiOutput(unsigned char io, unsigned char action) {
     switch (action) {
         case ACTION_IO_CONSUMER_1:  // SERVO Position 1
-            targetPos[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_multi.multi_pos1;
-            speed[io] = nodeVarTable.moduleNVs.servo_speed;
-            eventFlags[io] = EVENT_FLAG_ON;
-            servoState[io] = MOVING;
+            startMove(io, ioConfig[io].nv.nv_io.nv_multi.multi_pos1,
+                    nodeVarTable.moduleNVs.servo_speed, EVENT_FLAG_ON, ACTION_IO_PRODUCER_MULTI_AT1(io));
             break;
         case ACTION_IO_CONSUMER_2:  // SERVO Position 2
-            targetPos[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_multi.multi_pos2;
-            speed[io] = nodeVarTable.moduleNVs.servo_speed;
-            eventFlags[io] = EVENT_FLAG_ON;
-            servoState[io] = MOVING;
+            startMove(io, ioConfig[io].nv.nv_io.nv_multi.multi_pos2,
+                    nodeVarTable.moduleNVs.servo_speed, EVENT_FLAG_ON, ACTION_IO_PRODUCER_MULTI_AT2(io));
             break;
         case ACTION_IO_CONSUMER_3:  // SERVO Position 3
-            if (nodeVarTable.moduleNVs.io[io].nv_io.nv_multi.multi_num_pos >= 3) {
-                targetPos[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_multi.multi_pos3;
-                speed[io] = nodeVarTable.moduleNVs.servo_speed;
-                eventFlags[io] = EVENT_FLAG_ON;
-                servoState[io] = MOVING;
+            if (ioConfig[io].nv.nv_io.nv_multi.multi_num_pos >= 3) {
+                startMove(io, ioConfig[io].nv.nv_io.nv_multi.multi_pos3,
+                        nodeVarTable.moduleNVs.servo_speed, EVENT_FLAG_ON, ACTION_IO_PRODUCER_MULTI_AT3(io));
             }
             break;
         case ACTION_IO_CONSUMER_4:  // SERVO Position 4
-            if (nodeVarTable.moduleNVs.io[io].nv_io.nv_multi.multi_num_pos >= 4) {
-                targetPos[io] = nodeVarTable.moduleNVs.io[io].nv_io.nv_multi.multi_pos4;
-                speed[io] = nodeVarTable.moduleNVs.servo_speed;
-                eventFlags[io] = EVENT_FLAG_ON;
-                servoState[io] = MOVING;
+            if (ioConfig[io].nv.nv_io.nv_multi.multi_num_pos >= 4) {
+                startMove(io, ioConfig[io].nv.nv_io.nv_multi.multi_pos4,
+                        nodeVarTable.moduleNVs.servo_speed, EVENT_FLAG_ON, ACTION_IO_PRODUCER_MULTI_AT4(io));
             }
             break;
     }
 }
 
-
@@ -0,0 +1,107 @@
+/* 
+ * File:   stateReport.c
+ * Author: Ian
+ * 
+ * Answer a consumed Start of Day by sending the current state of every IO:
+ * the reported level of the inputs, the state of the digital outputs, the
+ * end position of the servos and the position of the multi-position outputs.
+ * 
+ * The IOs are walked one at a time from the main loop with at least the
+ * sodGap NV between the events, so when a SoD is answered by many modules
+ * at once the bus still has room for other traffic. Each event is only 
+ * queued when the low priority TX queue has more than STATE_REPORT_RESERVE
+ * entries free, otherwise the walk waits and carries on in a later pass.
+ * IOs with no known state send nothing and don't take a gap.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <stddef.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/TickTime.h"
+#include "../../CBUSlib/events.h"
+#include "../../CBUSlib/FLiM.h"
+#include "mioNv.h"
+#include "mioEvents.h"
+#include "ioCache.h"
+#include "inputs.h"
+#include "stateStore.h"
+#include "txQueue.h"
+#include "stateReport.h"
+
+#define NOT_REPORTING   NUM_IO
+
+static BYTE reportIo = NOT_REPORTING;   // the next IO to report
+static DWORD nextReport;                // earliest time for the next event
+
+static BOOL reportIoState(unsigned char io);
+static BOOL reportEvent(BYTE action, BOOL on);
+
+void startStateReport(void) {
+    reportIo = 0;
+    nextReport = tickGet();
+}
+
+void pollStateReport(void) {
+    if (reportIo >= NOT_REPORTING) return;
+    if ((long)(tickGet() - nextReport) < 0) return;
+    if (txQueueFree(TX_PRIORITY_LOW) <= STATE_REPORT_RESERVE) return;
+    while (reportIo < NOT_REPORTING) {
+        if (reportIoState(reportIo++)) {
+            nextReport = tickGet() + (DWORD)nodeVarTable.moduleNVs.sodGap * ONE_MILI_SECOND;
+            return;
+        }
+    }
+}
+
+/**
+ * Queue the Produced event which describes the current state of an IO.
+ * @param io
+ * @return TRUE if an event was queued
+ */
+static BOOL reportIoState(unsigned char io) {
+    BYTE action;
+    
+    if (ioConfig[io].nv.type == TYPE_INPUT) {
+        if (getInputState(io)) {
+            return reportEvent(ACTION_IO_PRODUCER_INPUT_OFF2ON(io), TRUE);
+        }
+        return reportEvent(ACTION_IO_PRODUCER_INPUT_ON2OFF(io), FALSE);
+    }
+    // the outputs report the last state they were asked for
+    action = getOutputState(io);
+    if (action == NO_STATE) return FALSE;
+    switch (ioConfig[io].nv.type) {
+        case TYPE_OUTPUT:
+            if (action == ACTION_IO_CONSUMER_3) {
+                return reportEvent(ACTION_IO_PRODUCER_OUTPUT_OFF(io), FALSE);
+            }
+            // ON or flashing
+            return reportEvent(ACTION_IO_PRODUCER_OUTPUT_ON(io), TRUE);
+        case TYPE_SERVO:
+            return reportEvent(ACTION_IO_PRODUCER_SERVO_ON(io), 
+                    (action == ACTION_IO_CONSUMER_2) ? TRUE : FALSE);
+        case TYPE_BOUNCE:
+            if (action == ACTION_IO_CONSUMER_2) {
+                return reportEvent(ACTION_IO_PRODUCER_BOUNCE_ON(io), TRUE);
+            }
+            return reportEvent(ACTION_IO_PRODUCER_BOUNCE_OFF(io), FALSE);
+        case TYPE_MULTI:
+            if (action > ACTION_IO_CONSUMER_4) return FALSE;
+            return reportEvent(ACTION_IO_PRODUCER_BASE(io) + action, TRUE);
+    }
+    return FALSE;
+}
+
+/**
+ * Queue a state report event. These always go in the low priority queue so 
+ * they never hold up a real input change.
+ * @param action the produced action
+ * @param on TRUE for an ON event
+ * @return TRUE if the action has an event and it was queued
+ */
+static BOOL reportEvent(BYTE action, BOOL on) {
+    const Event * ev = getProducedEvent(action);
+    if (ev == NULL) return FALSE;
+    return txQueueEvent(TX_PRIORITY_LOW, ev->NN, ev->EN, on);
+}
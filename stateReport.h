@@ -0,0 +1,35 @@
+/* 
+ * File:   stateReport.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef STATEREPORT_H
+#define	STATEREPORT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+    // Low priority TX queue entries kept free for the normal position feedback
+#define STATE_REPORT_RESERVE    8
+
+    /**
+     * Start reporting the state of every IO, from IO 0. A report already in
+     * progress starts again.
+     */
+    extern void startStateReport(void);
+    /**
+     * Send the next state report event if the gap has passed and there is
+     * room in the TX queue. Called every pass of the main loop.
+     */
+    extern void pollStateReport(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* STATEREPORT_H */
@@ -0,0 +1,167 @@
+/* 
+ * File:   stateStore.c
+ * Author: Ian
+ * 
+ * Persist the state of the outputs in EEPROM.
+ * 
+ * The state is kept as a journal, a ring of EE_JOURNAL_RECORDS records each 
+ * holding a sequence number, the last consumer action of every IO and a 
+ * checksum. A new record is written to the next slot in the ring each time,
+ * so each EEPROM location is only written once every EE_JOURNAL_RECORDS 
+ * records. On power up the valid record with the newest sequence number is used.
+ * 
+ * Writing is held back until no IO has changed for STATE_SETTLE_TIME (or at
+ * most STATE_MAX_HOLD after the first change) so a burst of changes from a 
+ * route or a series of moves is combined into one record. The record is then 
+ * written one byte per main loop pass by starting the EEPROM write directly 
+ * and coming back once it has completed, so the loop never waits for the ~4ms
+ * EEPROM write time. 
+ * 
+ * With 32 records and a data EEPROM endurance of 100,000 writes this is 
+ * 3.2 million records, over 10 years at one record every 2 minutes.
+ *
+ * Created on 14 October 2026
+ */
+
+#include <xc.h>
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/TickTime.h"
+#include "canmio.h"
+#include "mioEEPROM.h"
+#include "stateStore.h"
+
+#define STATE_SETTLE_TIME       (2*ONE_SECOND)
+#define STATE_MAX_HOLD          (30*ONE_SECOND)
+#define NOT_WRITING             0xFF
+
+extern BOOL servoPulsesDone(void);
+
+static BYTE outputState[NUM_IO];
+static BOOL dirty;
+static TickValue firstChange;
+static TickValue lastChange;
+
+static BYTE nextSlot;           // slot the next record is written to
+static BYTE sequence;           // sequence number of the newest record
+static BYTE record[EE_JOURNAL_RECORD_SIZE];
+static BYTE writeIndex;         // next byte of record to write, NOT_WRITING if idle
+
+/**
+ * Calculate the checksum of a record. Chosen so an erased or zeroed record
+ * is not valid.
+ */
+static BYTE checksum(BYTE * r) {
+    unsigned char i;
+    BYTE sum = 0;
+    
+    for (i=0; i<EE_JOURNAL_RECORD_SIZE-1; i++) {
+        sum += r[i];
+    }
+    return ~sum;
+}
+
+static WORD slotAddress(BYTE slot) {
+    return (WORD)EE_JOURNAL + (WORD)slot*EE_JOURNAL_RECORD_SIZE;
+}
+
+void initStateStore(void) {
+    unsigned char slot;
+    unsigned char i;
+    BYTE newest;
+    WORD addr;
+    
+    newest = NOT_WRITING;
+    for (slot=0; slot<EE_JOURNAL_RECORDS; slot++) {
+        addr = slotAddress(slot);
+        for (i=0; i<EE_JOURNAL_RECORD_SIZE; i++) {
+            record[i] = ee_read(addr+i);
+        }
+        if (record[EE_JOURNAL_RECORD_SIZE-1] != checksum(record)) continue;
+        // sequence numbers wrap so compare the difference
+        if ((newest == NOT_WRITING) || ((signed char)(record[0] - sequence) > 0)) {
+            newest = slot;
+            sequence = record[0];
+            for (i=0; i<NUM_IO; i++) {
+                outputState[i] = record[1+i];
+            }
+        }
+    }
+    if (newest == NOT_WRITING) {
+        // nothing saved yet
+        sequence = 0;
+        nextSlot = 0;
+        for (i=0; i<NUM_IO; i++) {
+            outputState[i] = NO_STATE;
+        }
+    } else {
+        nextSlot = newest+1;
+        if (nextSlot >= EE_JOURNAL_RECORDS) nextSlot = 0;
+    }
+    dirty = FALSE;
+    writeIndex = NOT_WRITING;
+}
+
+BYTE getOutputState(BYTE io) {
+    return outputState[io];
+}
+
+void saveOutputState(BYTE io, BYTE action) {
+    if (outputState[io] == action) return;
+    outputState[io] = action;
+    lastChange.Val = tickGet();
+    if (! dirty) {
+        firstChange.Val = lastChange.Val;
+        dirty = TRUE;
+    }
+}
+
+/**
+ * Start writing a byte to the data EEPROM. Doesn't wait for it to complete.
+ */
+static void startEepromWrite(WORD addr, BYTE data) {
+    BYTE intcon;
+    
+    EEADRH = addr >> 8;
+    EEADR = addr & 0xFF;
+    EEDATA = data;
+    EECON1bits.EEPGD = 0;   // data EEPROM
+    EECON1bits.CFGS = 0;
+    EECON1bits.WREN = 1;
+    intcon = INTCON;
+    INTCONbits.GIEH = 0;    // required sequence must not be interrupted
+    INTCONbits.GIEL = 0;
+    EECON2 = 0x55;
+    EECON2 = 0xAA;
+    EECON1bits.WR = 1;
+    INTCON |= (intcon & 0xC0);
+    EECON1bits.WREN = 0;
+}
+
+void pollStateStore(void) {
+    unsigned char i;
+    
+    if (EECON1bits.WR) return;  // previous byte still being written
+    if ( ! servoPulsesDone()) return;   // the write sequence holds off the servo ISR
+    if (writeIndex == NOT_WRITING) {
+        if (! dirty) return;
+        if ((tickTimeSince(lastChange) < STATE_SETTLE_TIME) && 
+                (tickTimeSince(firstChange) < STATE_MAX_HOLD)) return;
+        // take a snapshot, any later changes go into the next record
+        dirty = FALSE;
+        record[0] = sequence+1;
+        for (i=0; i<NUM_IO; i++) {
+            record[1+i] = outputState[i];
+        }
+        record[EE_JOURNAL_RECORD_SIZE-1] = checksum(record);
+        writeIndex = 0;
+    }
+    // The checksum is written last so a record interrupted by a power failure is never valid
+    startEepromWrite(slotAddress(nextSlot)+writeIndex, record[writeIndex]);
+    writeIndex++;
+    if (writeIndex >= EE_JOURNAL_RECORD_SIZE) {
+        writeIndex = NOT_WRITING;
+        sequence = record[0];
+        nextSlot++;
+        if (nextSlot >= EE_JOURNAL_RECORDS) nextSlot = 0;
+    }
+}
@@ -0,0 +1,43 @@
+/* 
+ * File:   stateStore.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef STATESTORE_H
+#define	STATESTORE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+#define NO_STATE                0xFF    // no state has been saved for the IO
+
+    /**
+     * Find the newest valid record in the journal and load it. Blocks so only
+     * call during initialisation.
+     */
+    extern void initStateStore(void);
+    /**
+     * @return the last saved consumer action for the IO or NO_STATE
+     */
+    extern BYTE getOutputState(BYTE io);
+    /**
+     * Remember the last consumer action for the IO. Written to EEPROM later.
+     */
+    extern void saveOutputState(BYTE io, BYTE action);
+    /**
+     * Write any changed state to the journal, one byte at a time. Called every
+     * pass of the main loop, never waits for the EEPROM.
+     */
+    extern void pollStateStore(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* STATESTORE_H */
+
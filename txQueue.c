@@ -0,0 +1,177 @@
+/* 
+ * File:   txQueue.c
+ * Author: Ian
+ * 
+ * A RAM queue for Produced events between the producers (inputs, outputs and
+ * servos) and the CAN driver. A burst of events is held here and passed to 
+ * the CAN driver from the main loop as its TX buffers become free, so neither
+ * the producers nor the main loop ever wait for the bus.
+ * 
+ * There are two priority classes, each a FIFO list through a shared pool of
+ * entries. Input events are sent before output and servo feedback events.
+ * The drop policy under load is:
+ * <UL>
+ * <LI>LOW events may use at most TX_QUEUE_LOW_SIZE entries, leaving the rest
+ * for HIGH. A LOW event which doesn't fit is dropped.</LI>
+ * <LI>A HIGH event which finds the pool full evicts the oldest LOW event, 
+ * the feedback most likely to have been superseded. It is only dropped if 
+ * every entry already holds a HIGH event.</LI>
+ * </UL>
+ * Every lost event is counted in txQueueStats.overflows.
+ *
+ * Created on 14 October 2026
+ */
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+#include "../../CBUSlib/FLiM.h"
+#include "txQueue.h"
+#include "perf.h"
+
+#define NO_ENTRY    0xFF
+
+typedef struct {
+    WORD nn;
+    WORD en;
+    BOOL on;
+    BYTE next;      // next entry in the queue or free list
+} TxEntry;
+
+static TxEntry entries[TX_QUEUE_SIZE];
+static BYTE heads[NUM_TX_PRIORITIES];     // next entry to send
+static BYTE tails[NUM_TX_PRIORITIES];     // last entry queued
+static BYTE counts[NUM_TX_PRIORITIES];    // number of entries queued
+static BYTE freeList;
+static BYTE freeCount;
+
+TxQueueStats txQueueStats;
+
+void initTxQueue(void) {
+    unsigned char p;
+    unsigned char i;
+    
+    for (p=0; p<NUM_TX_PRIORITIES; p++) {
+        heads[p] = NO_ENTRY;
+        tails[p] = NO_ENTRY;
+        counts[p] = 0;
+        txQueueStats.highWater[p] = 0;
+        txQueueStats.overflows[p] = 0;
+    }
+    for (i=0; i<TX_QUEUE_SIZE-1; i++) {
+        entries[i].next = i+1;
+    }
+    entries[TX_QUEUE_SIZE-1].next = NO_ENTRY;
+    freeList = 0;
+    freeCount = TX_QUEUE_SIZE;
+    txQueueStats.txFull = 0;
+}
+
+/**
+ * Take the oldest entry off a queue.
+ * @param priority the queue, which mustn't be empty
+ * @return the entry
+ */
+static BYTE removeHead(BYTE priority) {
+    BYTE e = heads[priority];
+    
+    heads[priority] = entries[e].next;
+    if (heads[priority] == NO_ENTRY) tails[priority] = NO_ENTRY;
+    counts[priority]--;
+    return e;
+}
+
+/**
+ * Queue an event for transmission.
+ * @param priority TX_PRIORITY_HIGH or TX_PRIORITY_LOW
+ * @param nn the event NN
+ * @param en the event EN
+ * @param on TRUE for an ON event
+ * @return FALSE if there was no room and the event was lost
+ */
+BOOL txQueueEvent(BYTE priority, WORD nn, WORD en, BOOL on) {
+    BYTE e;
+    
+    if (priority == TX_PRIORITY_LOW) {
+        if ((freeCount == 0) || (counts[TX_PRIORITY_LOW] >= TX_QUEUE_LOW_SIZE)) {
+            PERF_INC(txQueueStats.overflows[TX_PRIORITY_LOW]);
+            return FALSE;
+        }
+    } else if (freeCount == 0) {
+        if (counts[TX_PRIORITY_LOW] == 0) {
+            PERF_INC(txQueueStats.overflows[TX_PRIORITY_HIGH]);
+            return FALSE;
+        }
+        // make room by losing the oldest feedback event
+        e = removeHead(TX_PRIORITY_LOW);
+        PERF_INC(txQueueStats.overflows[TX_PRIORITY_LOW]);
+        entries[e].next = freeList;
+        freeList = e;
+        freeCount++;
+    }
+    e = freeList;
+    freeList = entries[e].next;
+    freeCount--;
+    entries[e].nn = nn;
+    entries[e].en = en;
+    entries[e].on = on;
+    entries[e].next = NO_ENTRY;
+    if (tails[priority] == NO_ENTRY) {
+        heads[priority] = e;
+    } else {
+        entries[tails[priority]].next = e;
+    }
+    tails[priority] = e;
+    counts[priority]++;
+    if (counts[priority] > txQueueStats.highWater[priority]) {
+        txQueueStats.highWater[priority] = counts[priority];
+    }
+    return TRUE;
+}
+
+/**
+ * Send queued events, highest priority first, until the queues are empty or
+ * the CAN driver has no more TX space. Events left are sent on a later call.
+ */
+void txQueueDrain(void) {
+    unsigned char p;
+    BYTE e;
+    TxEntry * entry;
+    
+    for (p=0; p<NUM_TX_PRIORITIES; p++) {
+        while (counts[p]) {
+            entry = &entries[heads[p]];
+            if ( ! cbusSendEvent(0, entry->nn, entry->en, entry->on)) {
+                // driver full, try again next time
+                PERF_INC(txQueueStats.txFull);
+                return;
+            }
+            PERF_INC(perf.canTx);
+            e = removeHead(p);
+            entries[e].next = freeList;
+            freeList = e;
+            freeCount++;
+        }
+    }
+}
+
+/**
+ * @param priority the queue
+ * @return the number of events of the priority which can be queued before 
+ * one is lost
+ */
+BYTE txQueueFree(BYTE priority) {
+    BYTE n;
+    
+    if (priority == TX_PRIORITY_HIGH) {
+        // LOW events would be evicted
+        return freeCount + counts[TX_PRIORITY_LOW];
+    }
+    n = TX_QUEUE_LOW_SIZE - counts[TX_PRIORITY_LOW];
+    return (n < freeCount) ? n : freeCount;
+}
+
+/**
+ * @return TRUE if nothing is waiting to be sent
+ */
+BOOL txQueueEmpty(void) {
+    return (freeCount == TX_QUEUE_SIZE) ? TRUE : FALSE;
+}
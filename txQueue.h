@@ -0,0 +1,63 @@
+/* 
+ * File:   txQueue.h
+ * Author: Ian
+ *
+ * Created on 14 October 2026
+ */
+
+#ifndef TXQUEUE_H
+#define	TXQUEUE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "../../CBUSlib/GenericTypeDefs.h"
+
+    /*
+     * The priority classes for produced events. HIGH is drained first.
+     */
+#define TX_PRIORITY_HIGH        0   // input (occupancy) events
+#define TX_PRIORITY_LOW         1   // output and servo position feedback
+#define NUM_TX_PRIORITIES       2
+
+    // The entries shared by the queues, and the most which LOW may use
+#define TX_QUEUE_SIZE           48
+#define TX_QUEUE_LOW_SIZE       32
+
+    typedef struct {
+        BYTE highWater[NUM_TX_PRIORITIES];  // most entries ever queued
+        WORD overflows[NUM_TX_PRIORITIES];  // events lost, LOW includes those evicted by HIGH
+        WORD txFull;                        // times the CAN driver could not take an event
+    } TxQueueStats;
+    
+    extern TxQueueStats txQueueStats;
+
+    extern void initTxQueue(void);
+    /**
+     * Queue an event for transmission. Never blocks. A HIGH event is only 
+     * lost if every entry holds a HIGH event, otherwise the oldest LOW event
+     * is evicted to make room.
+     * @return FALSE if the queue was full and the event was lost
+     */
+    extern BOOL txQueueEvent(BYTE priority, WORD nn, WORD en, BOOL on);
+    /**
+     * Pass queued events to the CAN driver until it is full. Called from the main loop.
+     */
+    extern void txQueueDrain(void);
+    /**
+     * @return the number of events of the priority which can be queued 
+     * before one is lost
+     */
+    extern BYTE txQueueFree(BYTE priority);
+    /**
+     * @return TRUE if nothing is waiting to be sent
+     */
+    extern BOOL txQueueEmpty(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TXQUEUE_H */
+